@@ -0,0 +1,63 @@
+#ifndef ACCUMULATION_HPP
+#define ACCUMULATION_HPP
+
+#include "scheduler.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Per-pixel running sums for a render. sum/count is the image; mean and m2 are
+// Welford's running luminance mean and squared deviation, only kept for
+// adaptive sampling. cost is only kept for --heatmap (see heatmap.hpp).
+// It covers image rows [y0, y0+rows), the whole frame normally or one band
+// of tiles when streaming; the backbuffer it averages into has the same layout.
+struct accumulation
+{
+    int w = 0, y0 = 0, rows = 0;
+    std::vector<float> sum;   // RGB, 3 per pixel
+    std::vector<int> count;
+    std::vector<float> mean;
+    std::vector<float> m2;
+    std::vector<float> cost;  // Object tests, shadow rays, nanoseconds: 3 per pixel
+
+    void init(int width, int first_row, int row_count, bool adaptive)
+    {
+        w = width;
+        y0 = first_row;
+        rows = row_count;
+        std::size_t pixels = std::size_t(w)*std::size_t(rows);
+        sum.assign(pixels*3, 0.0f);
+        count.assign(pixels, 0);
+        mean.assign(adaptive ? pixels : 0, 0.0f);
+        m2.assign(adaptive ? pixels : 0, 0.0f);
+        cost.clear();
+    }
+
+    bool adaptive() const { return !mean.empty(); }
+
+    std::size_t index(int x, int y) const { return std::size_t(w)*std::size_t(y - y0) + std::size_t(x); }
+
+    std::uint64_t samples() const
+    {
+        std::uint64_t n = 0;
+        for(int c : count)
+            n += std::uint64_t(c);
+        return n;
+    }
+
+    // Writes the average so far of t's pixels into the same spots of backbuffer
+    void average(const tile &t, std::vector<float> &backbuffer) const
+    {
+        for(int iv=t.y0; iv<t.y1; iv++)
+        for(int iu=t.x0; iu<t.x1; iu++)
+        {
+            std::size_t p = index(iu, iv);
+            float n = float(std::max(count[p], 1));
+            backbuffer[p*3 + 0] = sum[p*3 + 0]/n;
+            backbuffer[p*3 + 1] = sum[p*3 + 1]/n;
+            backbuffer[p*3 + 2] = sum[p*3 + 2]/n;
+        }
+    }
+};
+
+#endif // ACCUMULATION_HPP
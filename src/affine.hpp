@@ -0,0 +1,101 @@
+#ifndef AFFINE_HPP
+#define AFFINE_HPP
+
+#include <cmath>
+#include "vec.hpp"
+
+// Row-major 3x4 affine transform: the top three rows of a 4x4 whose last row is
+// always 0 0 0 1, so it is never stored. m[4*i + j] matches vec<float,16>'s layout
+// for i < 3, and the point/vector transforms sum in the same order as mul3_affine.
+struct affine3x4
+{
+    float m[12];
+
+    float operator[](int i) const { return m[i]; }
+
+    static affine3x4 identity()
+    {
+        return affine3x4{{1,0,0,0, 0,1,0,0, 0,0,1,0}};
+    }
+
+    // M*[x,1]
+    vec<float,3> point(const vec<float,3> &x) const
+    {
+        return vec<float,3>{
+            m[0]*x[0] + m[1]*x[1] + m[2]*x[2] + m[3],
+            m[4]*x[0] + m[5]*x[1] + m[6]*x[2] + m[7],
+            m[8]*x[0] + m[9]*x[1] + m[10]*x[2] + m[11]};
+    }
+
+    // M*[x,0]
+    vec<float,3> vector(const vec<float,3> &x) const
+    {
+        return vec<float,3>{
+            m[0]*x[0] + m[1]*x[1] + m[2]*x[2],
+            m[4]*x[0] + m[5]*x[1] + m[6]*x[2],
+            m[8]*x[0] + m[9]*x[1] + m[10]*x[2]};
+    }
+
+    // [x,0]*M, i.e. the transpose of the linear part applied to x. Called on
+    // model_from_world this takes normals to world space (inverse transpose).
+    vec<float,3> transpose_vector(const vec<float,3> &x) const
+    {
+        return vec<float,3>{
+            x[0]*m[0] + x[1]*m[4] + x[2]*m[8],
+            x[0]*m[1] + x[1]*m[5] + x[2]*m[9],
+            x[0]*m[2] + x[1]*m[6] + x[2]*m[10]};
+    }
+};
+
+// a*b, so (a*b).point(x) == a.point(b.point(x))
+inline affine3x4 operator*(const affine3x4 &a, const affine3x4 &b)
+{
+    affine3x4 r;
+    for(int i=0; i<3; i++)
+    {
+        for(int j=0; j<4; j++)
+            r.m[4*i + j] = a.m[4*i]*b.m[j] + a.m[4*i + 1]*b.m[4 + j] + a.m[4*i + 2]*b.m[8 + j];
+        r.m[4*i + 3] += a.m[4*i + 3];
+    }
+    return r;
+}
+
+// Translate * rotate(axis, angle) * scale, and its inverse, from one sin/cos.
+// The inverse is closed form: S^-1 * R^T * T^-1. A zero scale inverts to zero
+// on that axis rather than inf.
+inline void affine_trs(const vec<float,3> &t, const vec<float,3> &axis, float angle,
+    const vec<float,3> &s, affine3x4 &fwd, affine3x4 &inv)
+{
+    vec<float,3> a;
+    if(dot(axis,axis) < 1e-4f) a = vec<float,3>{1,0,0};
+    else a = normalize(axis);
+
+    float ct = std::cos(angle);
+    float st = std::sin(angle);
+
+    // Rodrigues on each basis vector gives R's columns
+    float R[9];
+    for(int j=0; j<3; j++)
+    {
+        vec<float,3> e{0.0f};
+        e[j] = 1.0f;
+        vec<float,3> col = e*ct + cross(a, e)*st + a*(a[j]*(1.0f - ct));
+        for(int i=0; i<3; i++)
+            R[3*i + j] = col[i];
+    }
+
+    for(int i=0; i<3; i++)
+    {
+        float is = (s[i] != 0.0f) ? 1.0f/s[i] : 0.0f;
+        for(int j=0; j<3; j++)
+        {
+            fwd.m[4*i + j] = R[3*i + j]*s[j];
+            inv.m[4*i + j] = R[3*j + i]*is;
+        }
+        fwd.m[4*i + 3] = t[i];
+    }
+    for(int i=0; i<3; i++)
+        inv.m[4*i + 3] = -(inv.m[4*i]*t[0] + inv.m[4*i + 1]*t[1] + inv.m[4*i + 2]*t[2]);
+}
+
+#endif // AFFINE_HPP
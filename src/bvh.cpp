@@ -0,0 +1,182 @@
+
+#include "bvh.hpp"
+
+namespace
+{
+
+const int SAH_BINS = 16;
+const int MAX_LEAF_SIZE = 4; // Raised to the leaf batch size when that is larger
+const float SAH_TRAVERSAL_COST = 1.0f;
+const float SAH_INTERSECT_COST = 1.0f;
+
+struct build_prim
+{
+    aabb box;
+    vec<float,3> c;
+    int id;
+};
+
+struct sah_bin
+{
+    aabb box;
+    int count = 0;
+};
+
+void set_bounds(bvh_node &node, const aabb &b)
+{
+    for(int k=0; k<3; k++)
+    {
+        node.lo[k] = b.lo[k];
+        node.hi[k] = b.hi[k];
+    }
+}
+
+void make_leaf(bvh &tree, int node_idx, std::vector<build_prim> &prims, int begin, int end)
+{
+    bvh_node &node = tree.nodes[node_idx];
+    node.offset = int(tree.prims.size());
+    node.count = end - begin;
+    for(int n=begin; n<end; n++)
+        tree.prims.push_back(prims[n].id);
+}
+
+// Leaf intersection cost for n primitives tested batch at a time
+inline float batches(int n, int batch)
+{
+    return float((n + batch - 1)/batch);
+}
+
+void build_recursive(bvh &tree, int node_idx, std::vector<build_prim> &prims,
+    int begin, int end, int depth, int batch)
+{
+    aabb box, cbox;
+    for(int n=begin; n<end; n++)
+    {
+        box.grow(prims[n].box);
+        cbox.grow(prims[n].c);
+    }
+    set_bounds(tree.nodes[node_idx], box);
+
+    int count = end - begin;
+    if(count <= 1 || depth >= BVH_STACK_SIZE - 2)
+    {
+        make_leaf(tree, node_idx, prims, begin, end);
+        return;
+    }
+
+    // Binned SAH: bin centroids along each axis and sweep the bin boundaries
+    float best_cost = 1e30f;
+    int best_axis = -1;
+    int best_split = -1;
+    vec<float,3> extent = cbox.hi - cbox.lo;
+    for(int axis=0; axis<3; axis++)
+    {
+        if(extent[axis] <= 0.0f) continue;
+        float scale = float(SAH_BINS)/extent[axis];
+
+        sah_bin bins[SAH_BINS];
+        for(int n=begin; n<end; n++)
+        {
+            int b = std::min(SAH_BINS - 1, int((prims[n].c[axis] - cbox.lo[axis])*scale));
+            bins[b].count++;
+            bins[b].box.grow(prims[n].box);
+        }
+
+        // Right-to-left sweep caches the right side's area and count per split
+        float right_area[SAH_BINS];
+        int right_count[SAH_BINS];
+        aabb acc;
+        int acc_count = 0;
+        for(int b=SAH_BINS-1; b>0; b--)
+        {
+            acc.grow(bins[b].box);
+            acc_count += bins[b].count;
+            right_area[b] = acc.surface_area();
+            right_count[b] = acc_count;
+        }
+
+        acc = aabb();
+        acc_count = 0;
+        for(int b=1; b<SAH_BINS; b++)
+        {
+            acc.grow(bins[b-1].box);
+            acc_count += bins[b-1].count;
+            if(acc_count == 0 || right_count[b] == 0) continue;
+            float cost = acc.surface_area()*batches(acc_count, batch)
+                + right_area[b]*batches(right_count[b], batch);
+            if(cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    float parent_area = box.surface_area();
+    float split_cost = SAH_TRAVERSAL_COST
+        + SAH_INTERSECT_COST*best_cost/((parent_area > 0.0f) ? parent_area : 1.0f);
+    float leaf_cost = SAH_INTERSECT_COST*batches(count, batch);
+
+    int mid;
+    if(best_axis < 0 || split_cost >= leaf_cost)
+    {
+        if(count <= std::max(MAX_LEAF_SIZE, batch))
+        {
+            make_leaf(tree, node_idx, prims, begin, end);
+            return;
+        }
+        // Too many to leave in a leaf but SAH found nothing (e.g. coincident
+        // centroids). Fall back to an object median along the widest axis.
+        int axis = 0;
+        if(extent[1] > extent[axis]) axis = 1;
+        if(extent[2] > extent[axis]) axis = 2;
+        mid = begin + count/2;
+        std::nth_element(prims.begin() + begin, prims.begin() + mid, prims.begin() + end,
+            [axis](const build_prim &a, const build_prim &b){ return a.c[axis] < b.c[axis]; });
+    }
+    else
+    {
+        float lo = cbox.lo[best_axis];
+        float scale = float(SAH_BINS)/extent[best_axis];
+        auto it = std::partition(prims.begin() + begin, prims.begin() + end,
+            [&](const build_prim &p){
+                return std::min(SAH_BINS - 1, int((p.c[best_axis] - lo)*scale)) < best_split;
+            });
+        mid = int(it - prims.begin());
+    }
+
+    // Left child is always node_idx + 1; the right child is wherever it lands.
+    int left = int(tree.nodes.size());
+    tree.nodes.emplace_back();
+    build_recursive(tree, left, prims, begin, mid, depth + 1, batch);
+
+    int right = int(tree.nodes.size());
+    tree.nodes.emplace_back();
+    build_recursive(tree, right, prims, mid, end, depth + 1, batch);
+
+    tree.nodes[node_idx].offset = right;
+    tree.nodes[node_idx].count = 0;
+}
+
+} // namespace
+
+void bvh::build(const std::vector<aabb> &bounds, const std::vector<int> &ids, int leaf_batch)
+{
+    nodes.clear();
+    prims.clear();
+    if(bounds.empty()) return;
+
+    std::vector<build_prim> build(bounds.size());
+    for(std::size_t n=0; n<bounds.size(); n++)
+    {
+        build[n].box = bounds[n];
+        build[n].c = bounds[n].centroid();
+        build[n].id = ids[n];
+    }
+
+    nodes.reserve(2*bounds.size());
+    prims.reserve(bounds.size());
+    nodes.emplace_back();
+    build_recursive(*this, 0, build, 0, int(build.size()), 0, std::max(1, leaf_batch));
+}
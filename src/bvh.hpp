@@ -0,0 +1,292 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <vector>
+#include <algorithm>
+#include "vec.hpp"
+#include "packet.hpp"
+
+struct aabb
+{
+    vec<float,3> lo{ 1e30f};
+    vec<float,3> hi{-1e30f};
+
+    void grow(const vec<float,3> &p) { lo = min(lo, p); hi = max(hi, p); }
+    void grow(const aabb &b) { lo = min(lo, b.lo); hi = max(hi, b.hi); }
+    vec<float,3> centroid() const { return (lo + hi)*0.5f; }
+    bool empty() const { return hi[0] < lo[0]; }
+
+    float surface_area() const
+    {
+        if(empty()) return 0.0f;
+        vec<float,3> e = hi - lo;
+        return 2.0f*(e[0]*e[1] + e[1]*e[2] + e[2]*e[0]);
+    }
+};
+
+// Flattened node, two per 64 byte line. Nodes are laid out depth first, so an
+// interior node's left child is always the next node and only the right child
+// needs an index.
+struct alignas(32) bvh_node
+{
+    float lo[3];
+    int   offset; // Interior: index of the right child. Leaf: first slot in bvh::prims.
+    float hi[3];
+    int   count;  // Number of primitives in a leaf, 0 for interior nodes.
+
+    bool is_leaf() const { return count > 0; }
+};
+static_assert(sizeof(bvh_node) == 32);
+
+struct bvh
+{
+    std::vector<bvh_node> nodes;
+    std::vector<int> prims; // Primitive ids in leaf order
+
+    // Binned SAH build over the given primitive bounds. ids[n] is reported for bounds[n].
+    // Leaves are assumed to be intersected leaf_batch primitives at a time (the SIMD
+    // width of the leaf kernel), so the SAH prices them per batch, not per primitive.
+    void build(const std::vector<aabb> &bounds, const std::vector<int> &ids, int leaf_batch = 1);
+
+    bool empty() const { return nodes.empty(); }
+
+    // Closest-hit traversal. intersect(first, count, t_max) tests the leaf's primitives
+    // prims[first .. first+count) and shrinks t_max if it finds something closer.
+    // Children are visited near-first so t_max shrinks as early as possible.
+    template<typename Intersect>
+    void traverse_closest(const vec<float,3> &org, const vec<float,3> &dir, float &t_max,
+        Intersect &&intersect) const;
+
+    // Any-hit traversal for shadow rays. intersect(first, count, t_max) returns true if
+    // a leaf primitive blocks the segment; traversal stops at the first one, in whatever
+    // order the stack yields (no near/far sorting, it doesn't pay for itself here).
+    template<typename Intersect>
+    bool traverse_any(const vec<float,3> &org, const vec<float,3> &dir, float t_max,
+        Intersect &&intersect) const;
+
+    // Packet versions. A node is entered if any live lane's slab test passes, so
+    // coherent rays share one walk. Closest: intersect(first, count, packet) shrinks
+    // the lanes' t_max and sets their prim. Any: intersect(first, count, live) returns
+    // the lanes it blocked; traverse_any returns every blocked lane.
+    template<typename Intersect>
+    void traverse_closest(ray_packet &pk, Intersect &&intersect) const;
+
+    template<typename Intersect>
+    int traverse_any(const ray_packet &pk, Intersect &&intersect) const;
+};
+
+// Slab test. Returns the entry distance, or 1e30 on a miss.
+inline float bvh_node_entry(const bvh_node &node, const vec<float,3> &org,
+    const vec<float,3> &inv_dir, float t_max)
+{
+    float t0 = 0.0f, t1 = t_max;
+    for(int k=0; k<3; k++)
+    {
+        float ta = (node.lo[k] - org[k])*inv_dir[k];
+        float tb = (node.hi[k] - org[k])*inv_dir[k];
+        if(ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+    }
+    return (t0 <= t1) ? t0 : 1e30f;
+}
+
+inline vec<float,3> bvh_inv_dir(const vec<float,3> &dir)
+{
+    // Avoid 0*inf NaNs in the slab test for axis aligned rays
+    vec<float,3> inv;
+    for(int k=0; k<3; k++)
+        inv[k] = 1.0f/((std::abs(dir[k]) > 1e-12f) ? dir[k] : 1e-12f);
+    return inv;
+}
+
+// Packet slab test. Returns the nearest entry over the lanes in live, or 1e30 if none hit.
+struct bvh_packet_rays
+{
+    simd_float ox, oy, oz;
+    simd_float ix, iy, iz;
+
+    explicit bvh_packet_rays(const ray_packet &pk)
+    {
+        float inv[3][SIMD_WIDTH];
+        for(int n=0; n<SIMD_WIDTH; n++)
+        {
+            vec<float,3> i = bvh_inv_dir(pk.dir(n));
+            for(int k=0; k<3; k++) inv[k][n] = i[k];
+        }
+        ox = simd_float::load(pk.ox); oy = simd_float::load(pk.oy); oz = simd_float::load(pk.oz);
+        ix = simd_float::load(inv[0]); iy = simd_float::load(inv[1]); iz = simd_float::load(inv[2]);
+    }
+};
+
+inline float bvh_node_entry(const bvh_node &node, const bvh_packet_rays &r,
+    simd_float t_max, simd_float live)
+{
+    auto slab = [](float lo, float hi, simd_float o, simd_float inv, simd_float &t0, simd_float &t1)
+    {
+        simd_float ta = (simd_float::set1(lo) - o)*inv;
+        simd_float tb = (simd_float::set1(hi) - o)*inv;
+        t0 = max(t0, min(ta, tb));
+        t1 = min(t1, max(ta, tb));
+    };
+    simd_float t0 = simd_float::set1(0.0f), t1 = t_max;
+    slab(node.lo[0], node.hi[0], r.ox, r.ix, t0, t1);
+    slab(node.lo[1], node.hi[1], r.oy, r.iy, t0, t1);
+    slab(node.lo[2], node.hi[2], r.oz, r.iz, t0, t1);
+    return hmin(select((t0 <= t1) & live, t0, simd_float::set1(1e30f)));
+}
+
+// build() caps the tree depth below this, so traversal stacks can't overflow.
+const int BVH_STACK_SIZE = 64;
+
+template<typename Intersect>
+void bvh::traverse_closest(const vec<float,3> &org, const vec<float,3> &dir, float &t_max,
+    Intersect &&intersect) const
+{
+    if(nodes.empty()) return;
+    vec<float,3> inv_dir = bvh_inv_dir(dir);
+
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int idx = 0;
+    if(bvh_node_entry(nodes[0], org, inv_dir, t_max) >= 1e30f) return;
+
+    while(true)
+    {
+        const bvh_node &node = nodes[idx];
+        if(node.is_leaf())
+        {
+            intersect(node.offset, node.count, t_max);
+        }
+        else
+        {
+            int a = idx + 1, b = node.offset;
+            float ta = bvh_node_entry(nodes[a], org, inv_dir, t_max);
+            float tb = bvh_node_entry(nodes[b], org, inv_dir, t_max);
+            if(tb < ta) { std::swap(a, b); std::swap(ta, tb); }
+            if(ta < 1e30f)
+            {
+                if(tb < 1e30f) stack[sp++] = b;
+                idx = a;
+                continue;
+            }
+        }
+
+        // Pop, skipping nodes the shrinking t_max has since ruled out
+        bool found = false;
+        while(sp > 0 && !found)
+        {
+            idx = stack[--sp];
+            found = bvh_node_entry(nodes[idx], org, inv_dir, t_max) < 1e30f;
+        }
+        if(!found) return;
+    }
+}
+
+template<typename Intersect>
+bool bvh::traverse_any(const vec<float,3> &org, const vec<float,3> &dir, float t_max,
+    Intersect &&intersect) const
+{
+    if(nodes.empty()) return false;
+    vec<float,3> inv_dir = bvh_inv_dir(dir);
+
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int idx = 0;
+    while(true)
+    {
+        const bvh_node &node = nodes[idx];
+        if(bvh_node_entry(node, org, inv_dir, t_max) < 1e30f)
+        {
+            if(!node.is_leaf())
+            {
+                stack[sp++] = node.offset;
+                idx++;
+                continue;
+            }
+            if(intersect(node.offset, node.count, t_max))
+                return true;
+        }
+        if(sp == 0) return false;
+        idx = stack[--sp];
+    }
+}
+
+template<typename Intersect>
+void bvh::traverse_closest(ray_packet &pk, Intersect &&intersect) const
+{
+    if(nodes.empty() || !pk.active) return;
+    bvh_packet_rays r(pk);
+    simd_float live = lane_mask(pk.active);
+
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int idx = 0;
+    if(bvh_node_entry(nodes[0], r, simd_float::load(pk.t_max), live) >= 1e30f) return;
+
+    while(true)
+    {
+        const bvh_node &node = nodes[idx];
+        if(node.is_leaf())
+        {
+            intersect(node.offset, node.count, pk);
+        }
+        else
+        {
+            simd_float t_max = simd_float::load(pk.t_max);
+            int a = idx + 1, b = node.offset;
+            float ta = bvh_node_entry(nodes[a], r, t_max, live);
+            float tb = bvh_node_entry(nodes[b], r, t_max, live);
+            if(tb < ta) { std::swap(a, b); std::swap(ta, tb); }
+            if(ta < 1e30f)
+            {
+                if(tb < 1e30f) stack[sp++] = b;
+                idx = a;
+                continue;
+            }
+        }
+
+        bool found = false;
+        while(sp > 0 && !found)
+        {
+            idx = stack[--sp];
+            found = bvh_node_entry(nodes[idx], r, simd_float::load(pk.t_max), live) < 1e30f;
+        }
+        if(!found) return;
+    }
+}
+
+template<typename Intersect>
+int bvh::traverse_any(const ray_packet &pk, Intersect &&intersect) const
+{
+    if(nodes.empty() || !pk.active) return 0;
+    bvh_packet_rays r(pk);
+    simd_float t_max = simd_float::load(pk.t_max);
+    int live_bits = pk.active;
+    simd_float live = lane_mask(live_bits);
+
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int idx = 0;
+    while(true)
+    {
+        const bvh_node &node = nodes[idx];
+        if(bvh_node_entry(node, r, t_max, live) < 1e30f)
+        {
+            if(!node.is_leaf())
+            {
+                stack[sp++] = node.offset;
+                idx++;
+                continue;
+            }
+            // Blocked lanes drop out, the rest keep walking
+            live_bits &= ~intersect(node.offset, node.count, live_bits);
+            if(!live_bits) return pk.active;
+            live = lane_mask(live_bits);
+        }
+        if(sp == 0) return pk.active & ~live_bits;
+        idx = stack[--sp];
+    }
+}
+
+#endif // BVH_HPP
@@ -0,0 +1,134 @@
+
+#include "checkpoint.hpp"
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+namespace
+{
+
+const char CHECKPOINT_MAGIC[8] = {'U','T','A','H','C','K','P','T'};
+const std::uint32_t CHECKPOINT_VERSION = 1;
+const std::uint32_t BYTE_ORDER_MARK = 0x01020304u;
+
+struct checkpoint_header
+{
+    char magic[8];
+    std::uint32_t version, byte_order;
+    std::uint32_t w, h, camera, seed, sampler, flags, spp;
+    std::uint64_t scene_hash;
+};
+
+template<typename T>
+void write_array(std::ofstream &file, const std::vector<T> &v)
+{
+    file.write(reinterpret_cast<const char*>(v.data()), std::streamsize(v.size()*sizeof(T)));
+}
+
+template<typename T>
+bool read_array(std::ifstream &file, std::vector<T> &v)
+{
+    file.read(reinterpret_cast<char*>(v.data()), std::streamsize(v.size()*sizeof(T)));
+    return bool(file);
+}
+
+} // namespace
+
+std::uint64_t hash_file(const std::filesystem::path &path)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    std::ifstream file(path, std::ios::binary);
+    char buf[1 << 16];
+    while(file.read(buf, sizeof(buf)) || file.gcount() > 0)
+    {
+        for(std::streamsize n=0; n<file.gcount(); n++)
+            hash = (hash ^ std::uint8_t(buf[n]))*0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::wstring write_checkpoint(const std::string &path, const checkpoint_info &info, const accumulation &acc)
+{
+    checkpoint_header hdr{};
+    std::copy(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC + 8, hdr.magic);
+    hdr.version = CHECKPOINT_VERSION;
+    hdr.byte_order = BYTE_ORDER_MARK;
+    hdr.w = std::uint32_t(info.w);
+    hdr.h = std::uint32_t(info.h);
+    hdr.camera = std::uint32_t(info.camera);
+    hdr.seed = info.seed;
+    hdr.sampler = info.sampler;
+    hdr.flags = info.adaptive ? 1u : 0u;
+    hdr.spp = std::uint32_t(info.spp);
+    hdr.scene_hash = info.scene_hash;
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        if(!file.is_open())
+            return L"Error opening checkpoint file";
+        file.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        write_array(file, acc.sum);
+        if(info.adaptive)
+        {
+            write_array(file, acc.count);
+            write_array(file, acc.mean);
+            write_array(file, acc.m2);
+        }
+        file.flush();
+        if(!file)
+            return L"Error writing checkpoint file";
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if(ec)
+        return L"Error replacing checkpoint file";
+    return L"";
+}
+
+std::wstring read_checkpoint(const std::string &path, const checkpoint_info &expect,
+    checkpoint_info &info, accumulation &acc)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open())
+        return L"Error opening checkpoint file";
+
+    checkpoint_header hdr{};
+    file.read(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+    if(!file || !std::equal(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC + 8, hdr.magic))
+        return L"Not a checkpoint file";
+    if(hdr.byte_order != BYTE_ORDER_MARK)
+        return L"Checkpoint was written on a machine with a different byte order";
+    if(hdr.version != CHECKPOINT_VERSION)
+        return L"Unsupported checkpoint version";
+
+    info.w = int(hdr.w);
+    info.h = int(hdr.h);
+    info.camera = int(hdr.camera);
+    info.seed = hdr.seed;
+    info.sampler = hdr.sampler;
+    info.adaptive = (hdr.flags & 1u) != 0;
+    info.spp = int(hdr.spp);
+    info.scene_hash = hdr.scene_hash;
+
+    if(info.scene_hash != expect.scene_hash) return L"Scene file has changed since the checkpoint";
+    if(info.camera != expect.camera) return L"Checkpoint is for another camera";
+    if(info.w != expect.w || info.h != expect.h) return L"Checkpoint resolution differs";
+    if(info.seed != expect.seed) return L"Checkpoint seed differs";
+    if(info.sampler != expect.sampler) return L"Checkpoint sampler differs";
+    if(info.adaptive != expect.adaptive) return L"Checkpoint adaptive sampling setting differs";
+
+    acc.init(info.w, 0, info.h, info.adaptive);
+    if(!read_array(file, acc.sum))
+        return L"Checkpoint file is truncated";
+    if(info.adaptive)
+    {
+        if(!read_array(file, acc.count) || !read_array(file, acc.mean) || !read_array(file, acc.m2))
+            return L"Checkpoint file is truncated";
+    }
+    else
+        acc.count.assign(acc.count.size(), info.spp);
+    return L"";
+}
@@ -0,0 +1,59 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "accumulation.hpp"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Saves a render in progress so a killed run can pick up where it stopped.
+// Samples are a pure function of (seed, pixel, sample index), so the RNG
+// position of every pixel is just its sample count: the accumulation plus the
+// seed and sampler is the whole state, and a resumed render comes out bit for
+// bit the same as one that was never interrupted.
+//
+// File layout, native byte order (the header's byte order mark catches a move
+// to a machine that disagrees):
+//   "UTAHCKPT" u32 version u32 0x01020304
+//   u32 w, h, camera, seed, sampler, flags (bit 0 adaptive), spp
+//   u64 scene hash
+//   f32 sum[w*h*3]
+//   adaptive only: i32 count[w*h], f32 mean[w*h], f32 m2[w*h]
+// Without adaptive sampling every pixel has spp samples, so counts aren't stored.
+
+// Everything a checkpoint has to agree with before it can be resumed
+struct checkpoint_info
+{
+    int w = 0, h = 0;
+    int camera = 0;
+    std::uint32_t seed = 0;
+    std::uint32_t sampler = 0; // sampler_type
+    bool adaptive = false;
+    std::uint64_t scene_hash = 0;
+    int spp = 0; // Samples per pixel issued so far
+};
+
+// FNV-1a over the scene file, so a checkpoint from an edited scene is refused
+std::uint64_t hash_file(const std::filesystem::path &path);
+
+// Written to path + ".tmp" and renamed over path, so a kill part way through
+// leaves the previous checkpoint intact. Empty string on success.
+std::wstring write_checkpoint(const std::string &path, const checkpoint_info &info, const accumulation &acc);
+
+// Checks the header against expect (all but spp) and fills acc for the full
+// frame and info.spp. Empty string on success, otherwise why it can't resume.
+std::wstring read_checkpoint(const std::string &path, const checkpoint_info &expect,
+    checkpoint_info &info, accumulation &acc);
+
+// When render_progressive saves: every interval seconds, on whole-pass
+// boundaries, and once more when it stops for any reason.
+struct checkpoint_schedule
+{
+    std::string path;
+    double interval = 300.0; // Seconds
+    checkpoint_info info;    // spp is filled in at each save
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+};
+
+#endif // CHECKPOINT_HPP
@@ -0,0 +1,224 @@
+
+#include "display.hpp"
+#include "stats.hpp"
+#include <SDL3/SDL.h>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+
+int sdl_test_01(){
+    if(!SDL_Init(SDL_INIT_VIDEO)) {
+        std::printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    std::printf("SDL initialized successfully.\n");
+    SDL_Quit();
+    return 0;
+}
+
+int sdl_test_02(){
+    if(!SDL_Init(SDL_INIT_VIDEO)) {
+        std::printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    SDL_Window* window = SDL_CreateWindow("SDL Test Window",
+        800, 600,
+        SDL_WINDOW_RESIZABLE
+    );
+
+    if (!window) {
+        std::printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_Quit();
+        return 1;
+    }
+
+    bool running = true;
+    while(running) {
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_EVENT_QUIT) {
+                running = false;
+            }
+        }
+        SDL_Delay(16); // Roughly 60 FPS
+    }
+
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
+
+int sdl_test_03(){
+    SDL_Init(SDL_INIT_VIDEO);
+
+    SDL_Window* window = SDL_CreateWindow("Framebuffer Test", 512, 512,
+        SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY
+    );
+    //SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL, 0);
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL);
+    // PFD_GENERIC_ACCELERATED?
+    // 
+
+
+    SDL_Texture* texture = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        512, 512
+    );
+
+    
+    std::vector<uint32_t> pixels(512 * 512);
+    for (int y = 0; y < 512; ++y)
+    {
+        for (int x = 0; x < 512; ++x)
+        {
+            uint8_t r = x & 0xFF;
+            uint8_t g = y & 0xFF;
+            uint8_t b = (64*((x / 256 + y / 256) % 4) - 1) & 0xFF;
+            uint8_t a = 255;
+            pixels[y * 512 + x] = (r << 24) | (g << 16) | (b << 8) | a;
+        }
+    }
+
+    SDL_UpdateTexture(texture, nullptr, pixels.data(), 512 * sizeof(uint32_t));
+
+    bool running = true;
+    while (running)
+    {
+        SDL_Event e;
+        while (SDL_PollEvent(&e))
+            if (e.type == SDL_EVENT_QUIT)
+                running = false;
+
+        SDL_RenderClear(renderer);
+        SDL_RenderTexture(renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+    }
+
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return 0;
+}
+
+int sdl_display_bbuffer(const std::vector<float> &backbuffer, const tonemapper &tm, int w, int h, tile_pool &pool){
+    SDL_Init(SDL_INIT_VIDEO);
+
+    SDL_Window* window = SDL_CreateWindow("Framebuffer Test", w, h,
+        SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY
+    );
+    //SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL, 0);
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL);
+    // PFD_GENERIC_ACCELERATED?
+    // 
+
+
+    SDL_Texture* texture = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        w, h
+    );
+
+    // Tone map straight into the texture's memory, leaving backbuffer alone
+    void *pixels = nullptr;
+    int pitch = 0;
+    stage_timer upload_timer("display");
+    if (SDL_LockTexture(texture, nullptr, &pixels, &pitch))
+    {
+        tonemap_rgba8(tm, backbuffer.data(), w, h, pixels, pitch, pool);
+        SDL_UnlockTexture(texture);
+    }
+    upload_timer.stop();
+
+    bool running = true;
+    while (running)
+    {
+        SDL_Event e;
+        while (SDL_PollEvent(&e))
+            if (e.type == SDL_EVENT_QUIT)
+                running = false;
+
+        SDL_RenderClear(renderer);
+        SDL_RenderTexture(renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+    }
+
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return 0;
+}
+
+int sdl_display_progressive(preview_buffer &preview, const tonemapper &tm, int w, int h, tile_pool &pool,
+    std::atomic<bool> &quit){
+    SDL_Init(SDL_INIT_VIDEO);
+
+    SDL_Window* window = SDL_CreateWindow("Utah Raytracer", w, h,
+        SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY
+    );
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL);
+    SDL_Texture* texture = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        w, h
+    );
+
+    // Black until the first pass lands
+    void *pixels = nullptr;
+    int pitch = 0;
+    if (SDL_LockTexture(texture, nullptr, &pixels, &pitch))
+    {
+        for (int y = 0; y < h; ++y)
+            std::fill_n(reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(pixels) + std::size_t(y)*std::size_t(pitch)), w, 0x000000FFu);
+        SDL_UnlockTexture(texture);
+    }
+
+    std::vector<float> frame;
+    std::uint64_t seen = 0;
+    int spp = 0;
+    bool running = true;
+    while (running)
+    {
+        SDL_Event e;
+        while (SDL_PollEvent(&e))
+            if (e.type == SDL_EVENT_QUIT)
+                running = false;
+
+        if (preview.fetch(frame, seen, spp))
+        {
+            stage_timer upload_timer("display"); // Tone map and upload, summed over frames
+            if (SDL_LockTexture(texture, nullptr, &pixels, &pitch))
+            {
+                tonemap_rgba8(tm, frame.data(), w, h, pixels, pitch, pool);
+                SDL_UnlockTexture(texture);
+            }
+            upload_timer.stop();
+
+            std::string title = "Utah Raytracer - " + std::to_string(spp) + " spp";
+            SDL_SetWindowTitle(window, title.c_str());
+        }
+
+        SDL_RenderClear(renderer);
+        SDL_RenderTexture(renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+        SDL_Delay(4); // Leave the cores to the render threads
+    }
+    quit = true;
+
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef DISPLAY_HPP
+#define DISPLAY_HPP
+
+#include <vector>
+#include <atomic>
+#include "preview.hpp"
+#include "tonemap.hpp"
+
+struct tile_pool;
+
+// SDL window output. Kept out of main.cpp so a headless build (make HEADLESS=1)
+// neither compiles nor links SDL.
+
+// Workers for tone mapping the progressive preview. They are their own pool so
+// packing a frame never waits on, or takes cores from, the render's passes.
+const int DISPLAY_THREADS = 4;
+
+int sdl_test_01();
+int sdl_test_02();
+int sdl_test_03();
+
+// Shows a w*h linear RGB backbuffer, tone mapped with tm on pool, until the
+// window is closed.
+int sdl_display_bbuffer(const std::vector<float> &backbuffer, const tonemapper &tm, int w, int h, tile_pool &pool);
+
+// Opens the window straight away and shows the newest (linear) frame in preview,
+// tone mapped with tm on pool whenever the renderer publishes a pass. pool must
+// not be the one the renderer uses. Returns once the window is closed, after
+// setting quit so the renderer can stop early.
+int sdl_display_progressive(preview_buffer &preview, const tonemapper &tm, int w, int h, tile_pool &pool,
+    std::atomic<bool> &quit);
+
+#endif // DISPLAY_HPP
@@ -0,0 +1,74 @@
+
+#include "heatmap.hpp"
+#include "image_io.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+
+const float HEATMAP_PERCENTILE = 0.99f;
+
+// Ruofei Du's degree 5 polynomial fit of Turbo
+void turbo(float x, std::uint8_t out[3])
+{
+    x = std::clamp(x, 0.0f, 1.0f);
+    float x2 = x*x, x3 = x2*x, x4 = x2*x2, x5 = x4*x;
+    float r = 0.13572138f + 4.61539260f*x - 42.66032258f*x2 + 132.13108234f*x3 - 152.94239396f*x4 + 59.28637943f*x5;
+    float g = 0.09140261f + 2.19418839f*x + 4.84296658f*x2 - 14.18503333f*x3 + 4.27729857f*x4 + 2.82956604f*x5;
+    float b = 0.10667330f + 12.64194608f*x - 60.58204836f*x2 + 110.36276771f*x3 - 89.90310912f*x4 + 27.34824973f*x5;
+    out[0] = std::uint8_t(std::lround(std::clamp(r, 0.0f, 1.0f)*255.0f));
+    out[1] = std::uint8_t(std::lround(std::clamp(g, 0.0f, 1.0f)*255.0f));
+    out[2] = std::uint8_t(std::lround(std::clamp(b, 0.0f, 1.0f)*255.0f));
+}
+
+} // namespace
+
+bool parse_heatmap_metric(const std::string &name, heatmap_metric &metric)
+{
+    if(name == "tests") metric = HEATMAP_TESTS;
+    else if(name == "shadow") metric = HEATMAP_SHADOW;
+    else if(name == "time") metric = HEATMAP_TIME;
+    else return false;
+    return true;
+}
+
+std::vector<std::uint8_t> heatmap_false_color(const std::vector<float> &cost, int w, int h, heatmap_metric metric)
+{
+    std::size_t pixels = std::size_t(w)*std::size_t(h);
+    std::vector<float> values(pixels);
+    for(std::size_t p=0; p<pixels; p++)
+        values[p] = cost[p*3 + metric];
+
+    std::vector<float> sorted = values;
+    std::size_t k = std::min(pixels - 1, std::size_t(float(pixels)*HEATMAP_PERCENTILE));
+    std::nth_element(sorted.begin(), sorted.begin() + std::ptrdiff_t(k), sorted.end());
+    float top = std::max(sorted[k], 1e-30f);
+
+    std::vector<std::uint8_t> rgb8(pixels*3);
+    for(std::size_t p=0; p<pixels; p++)
+        turbo(values[p]/top, &rgb8[p*3]);
+    return rgb8;
+}
+
+std::wstring write_heatmap(const std::string &base, const std::vector<float> &cost, int w, int h, heatmap_metric metric)
+{
+    std::wstring err = write_pfm(base + ".pfm", cost, w, h);
+    if(err != L"") return err;
+    err = write_png(base + ".png", heatmap_false_color(cost, w, h, metric), w, h);
+    if(err != L"") return err;
+
+    double tests = 0.0, shadow = 0.0, ns = 0.0, hottest = 0.0;
+    for(std::size_t p=0; p<cost.size()/3; p++)
+    {
+        tests += double(cost[p*3 + 0]);
+        shadow += double(cost[p*3 + 1]);
+        ns += double(cost[p*3 + 2]);
+        hottest = std::max(hottest, double(cost[p*3 + 2]));
+    }
+    double pixels = double(w)*double(h);
+    std::wcout << L"Heatmap: " << tests/pixels << L" object tests, " << shadow/pixels << L" shadow rays, "
+               << ns/pixels*1e-3 << L" us per pixel (hottest " << hottest*1e-3 << L" us)" << std::endl;
+    return L"";
+}
@@ -0,0 +1,35 @@
+#ifndef HEATMAP_HPP
+#define HEATMAP_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where a render spent its effort, per pixel. The render loop adds three
+// numbers per pixel over all of its samples (accumulation::cost):
+//   0  ray-object intersection tests, camera and shadow rays alike
+//   1  shadow rays
+//   2  nanoseconds, wall clock on the thread that rendered it
+// Packets share their cost evenly between their pixels.
+// --heatmap base writes base.pfm with those three as R, G, B (the raw
+// numbers) and base.png with one of them in false color.
+
+enum heatmap_metric : std::uint8_t
+{
+    HEATMAP_TESTS = 0,
+    HEATMAP_SHADOW = 1,
+    HEATMAP_TIME = 2,
+};
+
+// "tests", "shadow" or "time"; false if name is none of those.
+bool parse_heatmap_metric(const std::string &name, heatmap_metric &metric);
+
+// Turbo colormap (Mikhailov 2019, polynomial fit) of one channel of cost,
+// scaled so the 99th percentile is the top of the map and a few hot pixels
+// don't wash out the rest. 3 bytes per pixel, ready for write_png.
+std::vector<std::uint8_t> heatmap_false_color(const std::vector<float> &cost, int w, int h, heatmap_metric metric);
+
+// Writes base.pfm and base.png and logs the totals. Empty string on success.
+std::wstring write_heatmap(const std::string &base, const std::vector<float> &cost, int w, int h, heatmap_metric metric);
+
+#endif // HEATMAP_HPP
@@ -0,0 +1,230 @@
+
+#include "image_io.hpp"
+#include <fstream>
+#include <bit>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// CRC-32 as PNG chunks use it (reflected, poly 0xEDB88320)
+std::uint32_t crc32(const std::uint8_t *data, std::size_t len, std::uint32_t crc = 0)
+{
+    static std::uint32_t table[256];
+    static bool init = false;
+    if(!init)
+    {
+        for(std::uint32_t n=0; n<256; n++)
+        {
+            std::uint32_t c = n;
+            for(int k=0; k<8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : (c >> 1);
+            table[n] = c;
+        }
+        init = true;
+    }
+    crc = ~crc;
+    for(std::size_t n=0; n<len; n++)
+        crc = table[(crc ^ data[n]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void put_be32(std::vector<std::uint8_t> &out, std::uint32_t x)
+{
+    out.push_back(std::uint8_t(x >> 24));
+    out.push_back(std::uint8_t(x >> 16));
+    out.push_back(std::uint8_t(x >> 8));
+    out.push_back(std::uint8_t(x));
+}
+
+void put_chunk(std::vector<std::uint8_t> &out, const char *type, const std::vector<std::uint8_t> &data)
+{
+    put_be32(out, std::uint32_t(data.size()));
+    std::size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_be32(out, crc32(out.data() + start, out.size() - start));
+}
+
+void put_le(std::vector<char> &out, std::uint32_t x, int bytes)
+{
+    for(int k=0; k<bytes; k++)
+        out.push_back(char((x >> (8*k)) & 0xFF));
+}
+
+bool ends_with(const std::string &path, const char *ext)
+{
+    std::string e(ext);
+    return path.size() >= e.size() && path.compare(path.size() - e.size(), e.size(), e) == 0;
+}
+
+std::wstring write_bytes(const std::string &path, const char *data, std::size_t len)
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file.is_open())
+        return L"Error opening output file";
+    file.write(data, std::streamsize(len));
+    if(!file)
+        return L"Error writing output file";
+    return L"";
+}
+
+} // namespace
+
+std::wstring write_pfm(const std::string &path, const std::vector<float> &rgb, int w, int h)
+{
+    std::string header = "PF\n" + std::to_string(w) + " " + std::to_string(h) + "\n-1.0\n";
+    std::vector<char> out(header.begin(), header.end());
+    out.reserve(header.size() + std::size_t(w)*std::size_t(h)*12);
+
+    for(int y=h-1; y>=0; y--)
+    {
+        const float *row = rgb.data() + std::size_t(y)*std::size_t(w)*3;
+        for(int n=0; n<w*3; n++)
+            put_le(out, std::bit_cast<std::uint32_t>(row[n]), 4);
+    }
+    return write_bytes(path, out.data(), out.size());
+}
+
+std::wstring write_ppm(const std::string &path, const std::vector<std::uint8_t> &rgb8, int w, int h)
+{
+    std::string header = "P6\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n";
+    std::vector<char> out(header.begin(), header.end());
+    out.insert(out.end(), rgb8.begin(), rgb8.end());
+    return write_bytes(path, out.data(), out.size());
+}
+
+// Uncompressed PNG: zlib stored blocks, no external dependency. Files are
+// about as big as a PPM, which is fine for farm output that gets converted later.
+std::wstring write_png(const std::string &path, const std::vector<std::uint8_t> &rgb8, int w, int h)
+{
+    // Filter type 0 in front of each row
+    std::vector<std::uint8_t> raw;
+    raw.reserve(std::size_t(h)*(std::size_t(w)*3 + 1));
+    for(int y=0; y<h; y++)
+    {
+        raw.push_back(0);
+        const std::uint8_t *row = rgb8.data() + std::size_t(y)*std::size_t(w)*3;
+        raw.insert(raw.end(), row, row + std::size_t(w)*3);
+    }
+
+    std::vector<std::uint8_t> z;
+    z.push_back(0x78);
+    z.push_back(0x01);
+    std::size_t pos = 0;
+    do
+    {
+        std::size_t len = std::min<std::size_t>(65535, raw.size() - pos);
+        bool last = pos + len == raw.size();
+        z.push_back(last ? 1 : 0);
+        z.push_back(std::uint8_t(len & 0xFF));
+        z.push_back(std::uint8_t(len >> 8));
+        z.push_back(std::uint8_t(~len & 0xFF));
+        z.push_back(std::uint8_t((~len >> 8) & 0xFF));
+        z.insert(z.end(), raw.begin() + std::ptrdiff_t(pos), raw.begin() + std::ptrdiff_t(pos + len));
+        pos += len;
+    } while(pos < raw.size());
+
+    std::uint32_t a = 1, b = 0; // Adler-32
+    for(std::uint8_t c : raw)
+    {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_be32(z, (b << 16) | a);
+
+    std::vector<std::uint8_t> ihdr;
+    put_be32(ihdr, std::uint32_t(w));
+    put_be32(ihdr, std::uint32_t(h));
+    ihdr.push_back(8); // Bit depth
+    ihdr.push_back(2); // Truecolor
+    ihdr.push_back(0); // Deflate
+    ihdr.push_back(0); // Adaptive filtering
+    ihdr.push_back(0); // No interlace
+
+    const std::uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<std::uint8_t> out(signature, signature + 8);
+    put_chunk(out, "IHDR", ihdr);
+    put_chunk(out, "IDAT", z);
+    put_chunk(out, "IEND", {});
+    return write_bytes(path, reinterpret_cast<const char*>(out.data()), out.size());
+}
+
+std::wstring write_image(const std::string &path, const std::vector<float> &hdr,
+    const std::vector<std::uint8_t> &rgb8, int w, int h)
+{
+    if(ends_with(path, ".pfm")) return write_pfm(path, hdr, w, h);
+    if(ends_with(path, ".ppm")) return write_ppm(path, rgb8, w, h);
+    if(ends_with(path, ".png")) return write_png(path, rgb8, w, h);
+    return L"Unknown output format, expected .pfm, .ppm or .png";
+}
+
+std::uint16_t float_to_half(float f)
+{
+    std::uint32_t x = std::bit_cast<std::uint32_t>(f);
+    std::uint16_t sign = std::uint16_t((x >> 16) & 0x8000u);
+    x &= 0x7FFFFFFFu;
+
+    if(x >= 0x47800000u) // 65536 and up, infinities and NaNs
+        return sign | ((x > 0x7F800000u) ? 0x7E00u : 0x7C00u);
+    if(x < 0x38800000u) // Below 2^-14: subnormal, in units of 2^-24
+        return sign | std::uint16_t(std::nearbyint(std::bit_cast<float>(x)*16777216.0f));
+
+    // Rebias the exponent and round the 13 dropped mantissa bits to even.
+    // A carry out of the mantissa bumps the exponent, up to infinity.
+    x -= 112u << 23;
+    x = (x + 0x0FFFu + ((x >> 13) & 1u)) >> 13;
+    return sign | std::uint16_t(x);
+}
+
+std::wstring image_stream::open(const std::string &path, int width, int height)
+{
+    w = width;
+    h = height;
+    std::string header;
+    if(ends_with(path, ".pfm"))
+    {
+        half = false;
+        header = "PF\n" + std::to_string(w) + " " + std::to_string(h) + "\n-1.0\n";
+    }
+    else if(ends_with(path, ".half"))
+    {
+        half = true;
+        header = "HF\n" + std::to_string(w) + " " + std::to_string(h) + "\n";
+    }
+    else
+        return L"Unknown stream format, expected .pfm or .half";
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+        return L"Error opening output file";
+    file.write(header.data(), std::streamsize(header.size()));
+    data_start = std::streamoff(header.size());
+    return file ? L"" : L"Error writing output file";
+}
+
+std::wstring image_stream::write_rows(int y0, int rows, const float *rgb)
+{
+    std::size_t row_values = std::size_t(w)*3;
+    std::vector<char> out;
+    out.reserve(std::size_t(rows)*row_values*(half ? 2 : 4));
+
+    // PFM rows are bottom up, so the band is written reversed, starting at its last row
+    int first_stored = half ? y0 : h - (y0 + rows);
+    for(int k=0; k<rows; k++)
+    {
+        const float *row = rgb + std::size_t(half ? k : rows - 1 - k)*row_values;
+        for(std::size_t n=0; n<row_values; n++)
+        {
+            if(half) put_le(out, float_to_half(row[n]), 2);
+            else put_le(out, std::bit_cast<std::uint32_t>(row[n]), 4);
+        }
+    }
+
+    std::streamoff row_bytes = std::streamoff(row_values)*(half ? 2 : 4);
+    file.seekp(data_start + std::streamoff(first_stored)*row_bytes);
+    file.write(out.data(), std::streamsize(out.size()));
+    file.flush();
+    return file ? L"" : L"Error writing output file";
+}
@@ -0,0 +1,46 @@
+#ifndef IMAGE_IO_HPP
+#define IMAGE_IO_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+
+// Writers for w*h RGB images, rows top to bottom, 3 values per pixel.
+// Each returns an empty string on success or an error message, like read_xml.
+
+// Portable float map of the linear HDR framebuffer, full precision. Little
+// endian, rows stored bottom up as the format wants.
+std::wstring write_pfm(const std::string &path, const std::vector<float> &rgb, int w, int h);
+
+// 8-bit outputs take pixels already tone mapped (tonemap_rgb8), the same
+// codes the SDL display shows.
+std::wstring write_ppm(const std::string &path, const std::vector<std::uint8_t> &rgb8, int w, int h);
+std::wstring write_png(const std::string &path, const std::vector<std::uint8_t> &rgb8, int w, int h);
+
+// Picks the writer from the extension (.pfm, .ppm, .png) and hands it hdr or rgb8.
+std::wstring write_image(const std::string &path, const std::vector<float> &hdr,
+    const std::vector<std::uint8_t> &rgb8, int w, int h);
+
+// Writes a w*h RGB image a band of rows at a time as the renderer finishes them,
+// so the full frame never has to be in memory. Each band goes straight to its
+// final offset in the file, so bands may arrive in any order.
+//   .pfm   float32, the same file write_pfm makes (rows stored bottom up)
+//   .half  "HF\n<w> <h>\n" then rows top to bottom of little-endian half-float
+//          RGB, half the size of a PFM for the same image
+struct image_stream
+{
+    std::wstring open(const std::string &path, int w, int h);
+    std::wstring write_rows(int y0, int rows, const float *rgb);
+
+private:
+    std::ofstream file;
+    int w = 0, h = 0;
+    bool half = false;
+    std::streamoff data_start = 0;
+};
+
+// IEEE binary16, round to nearest even; overflow goes to infinity
+std::uint16_t float_to_half(float f);
+
+#endif // IMAGE_IO_HPP
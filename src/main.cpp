@@ -1,8 +1,10 @@
 
 #include <iostream>
+#ifdef _WIN32
 #include <fcntl.h>
 #include <Windows.h>
 #include <io.h>
+#endif
 
 #include <math.h>
 #include <array>
@@ -10,226 +12,38 @@
 #include "xml.hpp"
 #include "xml_compiler.hpp"
 
-#include <SDL3/SDL.h>
+#ifndef UTAH_HEADLESS
+#include "display.hpp"
+#endif
+#include "image_io.hpp"
+#include "preview.hpp"
+#include "accumulation.hpp"
+#include "checkpoint.hpp"
+#include "stats.hpp"
+#include "heatmap.hpp"
+#include "trace.hpp"
+#include "tonemap.hpp"
 #include <cstdio>
+#include <cstdlib>
 
 #include "einsum_variadic_ct.hpp"
 #include "vec.hpp"
+#include "scheduler.hpp"
+#include "rng.hpp"
+#include "sampler.hpp"
+#include "bvh.hpp"
+#include "sphere_simd.hpp"
+#include "render_scene.hpp"
+#include "affine.hpp"
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////
 #include <bit>
 #include <cstdint>
 #include <cmath>
 #include <chrono>
-
-unsigned long xorshfnums[3] = {123456789, 362436069, 521288629}; // I think these are random, and can be randomized using a seed
-unsigned long xorshift96(void) // YOINK http://stackoverflow.com/questions/1640258/need-a-fast-random-generator-for-c
-{          //period 2^96-1
-	unsigned long t;
-	xorshfnums[0] ^= xorshfnums[0] << 16;
-	xorshfnums[0] ^= xorshfnums[0] >> 5;
-	xorshfnums[0] ^= xorshfnums[0] << 1;
-
-	t = xorshfnums[0];
-	xorshfnums[0] = xorshfnums[1];
-	xorshfnums[1] = xorshfnums[2];
-	xorshfnums[2] = t ^ xorshfnums[0] ^ xorshfnums[1];
-
-	return xorshfnums[2];
-}
-double xorshiftdbl(void)
-{ // Double: sign bit, 11 exponent bits, 52 fraction bits,  0x3ff0000000000000 = Exponent and Power section, equivelant to 1
-	std::uint64_t x = 0x3ff0000000000000ull | (std::uint64_t(xorshift96()) << 20); //xorshift92 is 32 bits long, 32 - 52 = 20 bits shifted
-	return std::bit_cast<double>(x) - 1.0;
-}
-float xorshiftflt(void)
-{ // Float: sign bit, 8 exponent bits, 23 fraction bits. 0x3f800000 = 1.0f
-	std::uint32_t x = 0x3f800000u | (std::uint32_t(xorshift96()) >> 9); // use top 23 bits from xorshift96
-	return std::bit_cast<float>(x) - 1.0f;//*(float*)&x - 1.0f;
-}
-////////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////
-
-int sdl_test_01(){
-    if(!SDL_Init(SDL_INIT_VIDEO)) {
-        std::printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
-        return 1;
-    }
-
-    std::printf("SDL initialized successfully.\n");
-    SDL_Quit();
-    return 0;
-}
-
-int sdl_test_02(){
-    if(!SDL_Init(SDL_INIT_VIDEO)) {
-        std::printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
-        return 1;
-    }
-
-    SDL_Window* window = SDL_CreateWindow("SDL Test Window",
-        800, 600,
-        SDL_WINDOW_RESIZABLE
-    );
-
-    if (!window) {
-        std::printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
-        SDL_Quit();
-        return 1;
-    }
-
-    bool running = true;
-    while(running) {
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_EVENT_QUIT) {
-                running = false;
-            }
-        }
-        SDL_Delay(16); // Roughly 60 FPS
-    }
-
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-    return 0;
-}
-
-int sdl_test_03(){
-    SDL_Init(SDL_INIT_VIDEO);
-
-    SDL_Window* window = SDL_CreateWindow("Framebuffer Test", 512, 512,
-        SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY
-    );
-    //SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL, 0);
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL);
-    // PFD_GENERIC_ACCELERATED?
-    // 
-
-
-    SDL_Texture* texture = SDL_CreateTexture(
-        renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_STREAMING,
-        512, 512
-    );
-
-    
-    std::vector<uint32_t> pixels(512 * 512);
-    for (int y = 0; y < 512; ++y)
-    {
-        for (int x = 0; x < 512; ++x)
-        {
-            uint8_t r = x & 0xFF;
-            uint8_t g = y & 0xFF;
-            uint8_t b = (64*((x / 256 + y / 256) % 4) - 1) & 0xFF;
-            uint8_t a = 255;
-            pixels[y * 512 + x] = (r << 24) | (g << 16) | (b << 8) | a;
-        }
-    }
-
-    SDL_UpdateTexture(texture, nullptr, pixels.data(), 512 * sizeof(uint32_t));
-
-    bool running = true;
-    while (running)
-    {
-        SDL_Event e;
-        while (SDL_PollEvent(&e))
-            if (e.type == SDL_EVENT_QUIT)
-                running = false;
-
-        SDL_RenderClear(renderer);
-        SDL_RenderTexture(renderer, texture, nullptr, nullptr);
-        SDL_RenderPresent(renderer);
-    }
-
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-
-    return 0;
-}
-
-int sdl_display_bbuffer(std::vector<float> &backbuffer, int w, int h){
-    SDL_Init(SDL_INIT_VIDEO);
-
-    SDL_Window* window = SDL_CreateWindow("Framebuffer Test", w, h,
-        SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY
-    );
-    //SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL, 0);
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL);
-    // PFD_GENERIC_ACCELERATED?
-    // 
-
-
-    SDL_Texture* texture = SDL_CreateTexture(
-        renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_STREAMING,
-        w, h
-    );
-
-    /*
-    float lo = 1e30f;
-    float hi = -1e30f;
-    for(const float &f : backbuffer)
-    {
-        lo = std::min(lo, f);
-        hi = std::max(hi, f);
-    }
-    std::cout << "lo = " << lo << " hi " << hi << std::endl;
-    
-    if (hi <= lo) {
-        // avoid division by zero / degenerate range — set to mid-gray
-        for(float &f : backbuffer)
-            f = 127.0f;
-    } else {
-        for(float &f : backbuffer)
-            f = 255.0f*(f - lo)/(hi - lo);
-    }
-    */
-
-    for(float &f : backbuffer)
-        f = std::min(255.0f, std::max(0.0f, f*255.0f));
-
-    std::vector<uint32_t> pixels(w*h);
-    for (int y = 0; y < h; ++y)
-    {
-        for (int x = 0; x < w; ++x)
-        {
-            uint8_t r = uint8_t(backbuffer[(w*y + x)*3 + 0]);
-            uint8_t g = uint8_t(backbuffer[(w*y + x)*3 + 1]);
-            uint8_t b = uint8_t(backbuffer[(w*y + x)*3 + 2]);
-            uint8_t a = 255;
-            pixels[y * w + x] = (r << 24) | (g << 16) | (b << 8) | a;
-        }
-    }
-
-    SDL_UpdateTexture(texture, nullptr, pixels.data(), w * sizeof(uint32_t));
-
-    bool running = true;
-    while (running)
-    {
-        SDL_Event e;
-        while (SDL_PollEvent(&e))
-            if (e.type == SDL_EVENT_QUIT)
-                running = false;
-
-        SDL_RenderClear(renderer);
-        SDL_RenderTexture(renderer, texture, nullptr, nullptr);
-        SDL_RenderPresent(renderer);
-    }
-
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-
-    return 0;
-}
+#include <filesystem>
+#include <atomic>
+#include <csignal>
+#include <thread>
 
 // std::vector is a dynamic array with no operations defined,
 // std::array is a fixed array *at compile time* with no operations defined,
@@ -386,49 +200,31 @@ static inline vec<float,16> rotate4(const vec<float,3> axis, float angle)
     return R;
 }
 
-// local model->parent: L = T * S  (scale then translate)
-static inline vec<float,16> local_model_to_parent(const object& sph)
+// local model->parent: L = T * R * S (scale, rotate, then translate), and its
+// inverse S^-1 * R^T * T^-1 built from the same sin/cos
+static inline void local_transforms(const object& sph, affine3x4 &L, affine3x4 &iL)
 {
-    vec<float,16> T = translate4(vec<float,3>(sph.pos,3));
-    vec<float,16> R = rotate4(vec<float,3>(sph.rotation,3), sph.rotation[3]);
-    vec<float,16> S = scale4(vec<float,3>(sph.scale,3));
-
-    vec<float,16> res{};
-    auto Tt = make_tensor<labels_t<0,1>, shape_t<4,4>>(T.data());
-    auto Rt = make_tensor<labels_t<1,2>, shape_t<4,4>>(R.data());
-    auto St = make_tensor<labels_t<2,3>, shape_t<4,4>>(S.data());
-    einsum_into<0,3>(res.data(), Tt, Rt, St);
-    return res;
+    affine_trs(vec<float,3>(sph.pos,3), vec<float,3>(sph.rotation,3), sph.rotation[3],
+        vec<float,3>(sph.scale,3), L, iL);
 }
 
-// inverse: (T*S)^-1 = S^-1 * T^-1
-static inline vec<float,16> local_parent_to_model(const object& sph)
+// All traversal produces: how far along the normalized ray, and which object.
+// Positions, normals and materials are only worked out for the final closest hit,
+// by surface_at().
+struct hit_record
 {
-    vec<float,3> t = vec<float,3>(sph.pos,3);
-    vec<float,3> s = vec<float,3>(sph.scale,3);
-    vec<float,3> is;
-    for(int n=0;n<3;n++)
-        is[n] = (s[n] != 0.0f) ? 1.0f/s[n] : 0.0f;
-
-    vec<float,16> iS = scale4(is);
-    vec<float,16> iR = rotate4(vec<float,3>(sph.rotation,3), -sph.rotation[3]);
-    vec<float,16> iT = translate4(-t);
+    float t = 1e30f;
+    int object = -1; // Index into render_scene::objects, -1 on a miss
 
-    vec<float,16> res{};
-    auto iTt = make_tensor<labels_t<2,3>, shape_t<4,4>>(iT.data());
-    auto iRt = make_tensor<labels_t<1,2>, shape_t<4,4>>(iR.data());
-    auto iSt = make_tensor<labels_t<0,1>, shape_t<4,4>>(iS.data());
-    einsum_into<0,3>(res.data(), iSt, iRt, iTt);
-    return res;
-
-    //return mul44_44(iS, iT);
-}
+    bool hit() const { return 0 <= object; }
+};
 
-struct traverse_result
+struct surface_interaction
 {
-    float dist = 1e30f;
-    int hit = -1;
-    vec<float,3> hit_normal{0.0f};
+    vec<float,3> position{0.0f};
+    vec<float,3> normal{0.0f}; // World space, unit length
+    int entity = -1;           // -1 on a miss
+    int material = -1;         // Index into render_scene::materials, -1 if unresolved
 };
 
 vec<float,3> normal_world_from_model(const vec<float,3>& nM, const vec<float,16>& iW)
@@ -445,91 +241,300 @@ vec<float,3> normal_world_from_model(const vec<float,3>& nM, const vec<float,16>
 }
 
 
-traverse_result traverse(const vec<float,3> &pos, const vec<float,3> &dir0,
-    std::vector<vec<float,16>> &object_world_from_mdl,
-    std::vector<vec<float,16>> &object_mdl_from_world,
-    renderables &Renderables,
+// The geometry traverse() runs against, gathered so the backends share one signature.
+enum traverse_backend
+{
+    TRAVERSE_LINEAR = 0, // Scalar brute force over every object, kept as the reference
+    TRAVERSE_SIMD,       // Brute force, SIMD_WIDTH spheres per step
+    TRAVERSE_BVH         // BVH with SIMD leaves
+};
+
+struct scene_geometry
+{
+    const render_scene &scene;
+    const std::vector<affine3x4> &object_world_from_mdl;
+    const std::vector<affine3x4> &object_mdl_from_world;
+    const bvh &accel;
+    const sphere_soa &spheres; // In accel.prims order, so BVH leaves are lane ranges
+    traverse_backend backend;
+};
+
+// World bounds of object nsph's transformed unit sphere. Row i of the linear part
+// stretches the sphere by |row i| along world axis i.
+aabb object_world_bounds(const affine3x4 &W)
+{
+    aabb box;
+    for(int i=0; i<3; i++)
+    {
+        float c = W[4*i + 3];
+        float r = std::sqrt(W[4*i]*W[4*i] + W[4*i+1]*W[4*i+1] + W[4*i+2]*W[4*i+2]);
+        box.lo[i] = c - r;
+        box.hi[i] = c + r;
+    }
+    return box;
+}
+
+// Nearest root past EPS of a*t^2 + 2*b*t + c = 0, or -1 if there is none.
+float sphere_root(float a, float b, float c)
+{
+    float disc = b*b - a*c;
+    if (disc < 0.0f) return -1.0f; // no real roots -> miss
+
+    float sq = sqrtf(disc);
+    float t0 = (-b - sq)/a;
+    float t1 = (-b + sq)/a;
+
+    // pick nearest positive t (with a small epsilon to avoid self-intersection)
+    const float EPS = 1e-4f;
+    return (t0 > EPS) ? t0 : ((t1 > EPS) ? t1 : -1.0f);
+}
+
+// Ray against object nsph's unit sphere in model space, for PRIM_ELLIPSOID.
+// The transform is affine, so t is the same parameter in model and world space: for a
+// normalized dir it is the world distance. p and d come back in model space.
+float intersect_object_t(const scene_geometry &geo, int nsph, const vec<float,3> &pos,
+    const vec<float,3> &dir, vec<float,3> &p, vec<float,3> &d)
+{
+    const affine3x4 &iW = geo.object_mdl_from_world[nsph];
+
+    p = iW.point(pos);
+    d = iW.vector(dir);
+
+    // Solve a*t^2 + 2*b*t + c = 0  where b = dot(oc,dir) and c = dot(oc,oc) - r^2
+    return sphere_root(dot(d, d), dot(p, d), dot(p, p) - 1.0f);
+}
+
+// PRIM_SPHERE: the same quadratic, straight in world space with no transforms.
+float intersect_world_sphere_t(const vec<float,4> &sphere, const vec<float,3> &pos,
+    const vec<float,3> &dir)
+{
+    vec<float,3> oc = pos - vec<float,3>(sphere.array);
+    return sphere_root(dot(dir, dir), dot(oc, dir), dot(oc, oc) - sphere[3]*sphere[3]);
+}
+
+// Nearest root of either kind, or -1 on a miss.
+float object_t(const scene_geometry &geo, int nsph, const vec<float,3> &pos,
+    const vec<float,3> &dir)
+{
+    if(geo.scene.objects[nsph].type == PRIM_SPHERE)
+        return intersect_world_sphere_t(geo.scene.world_spheres[nsph], pos, dir);
+    vec<float,3> p, d;
+    return intersect_object_t(geo, nsph, pos, dir, p, d);
+}
+
+// Reference backend: test every object.
+hit_record traverse_linear(const vec<float,3> &pos, const vec<float,3> &dir,
+    const scene_geometry &geo, int src_id)
+{
+    const std::vector<render_object> &objects = geo.scene.objects;
+
+    hit_record rec;
+    for(int nsph=0; nsph<int(objects.size()); nsph++)
+    {
+        if(src_id == objects[nsph].entity)
+            continue;
+
+        if(!traceable(objects[nsph].type))
+            continue;
+
+        ray_stats.object_tests++;
+        float t = object_t(geo, nsph, pos, dir);
+        if (0.0f < t && t < rec.t) {
+            rec.t = t;
+            rec.object = nsph;
+        }
+    }
+    return rec;
+}
+
+hit_record traverse_simd(const vec<float,3> &pos, const vec<float,3> &dir,
+    const scene_geometry &geo, int src_id)
+{
+    hit_record rec;
+    ray_stats.object_tests += std::uint64_t(geo.spheres.count);
+    int lane = sphere_soa_closest(geo.spheres, 0, geo.spheres.count, pos, dir, src_id, rec.t);
+    if(lane >= 0) rec.object = geo.spheres.object[lane];
+    return rec;
+}
+
+hit_record traverse_bvh(const vec<float,3> &pos, const vec<float,3> &dir,
+    const scene_geometry &geo, int src_id)
+{
+    hit_record rec;
+    geo.accel.traverse_closest(pos, dir, rec.t, [&](int first, int count, float &t_max)
+    {
+        ray_stats.object_tests += std::uint64_t(count);
+        int lane = sphere_soa_closest(geo.spheres, first, first + count, pos, dir, src_id, t_max);
+        if(lane >= 0) rec.object = geo.spheres.object[lane];
+    });
+    return rec;
+}
+
+hit_record traverse(const vec<float,3> &pos, const vec<float,3> &dir0,
+    const scene_geometry &geo,
     int src_id=-2
 ){
+    vec<float,3> dir = normalize(dir0);
+
+    switch(geo.backend)
+    {
+        case TRAVERSE_LINEAR: return traverse_linear(pos, dir, geo, src_id);
+        case TRAVERSE_SIMD:   return traverse_simd(pos, dir, geo, src_id);
+        case TRAVERSE_BVH:    return traverse_bvh(pos, dir, geo, src_id);
+    }
+    return hit_record{};
+}
+
+// Hit position, normal and material for a record traverse() returned for the same ray.
+surface_interaction surface_at(const scene_geometry &geo, const vec<float,3> &pos,
+    const vec<float,3> &dir0, const hit_record &rec)
+{
     typedef vec<float,3> vec3;
+    surface_interaction si;
+    if(!rec.hit()) return si;
 
-    vec<float,3> dir = normalize(dir0);
+    vec3 dir = normalize(dir0);
+    const render_object &obj = geo.scene.objects[rec.object];
+    si.entity = obj.entity;
+    si.material = obj.material;
+    si.position = pos + dir*rec.t;
 
-    float t_min = 1e30f;
-    int hit = -1;
-    vec3 hit_normal{0.0f};
+    if(obj.type == PRIM_SPHERE)
+    {
+        const vec<float,4> &sphere = geo.scene.world_spheres[rec.object];
+        si.normal = (si.position - vec3(sphere.array))/sphere[3];
+    }
+    else
+    {
+        // t is the same parameter in model space
+        const affine3x4 &iW = geo.object_mdl_from_world[rec.object];
+        vec3 p = iW.point(pos) + iW.vector(dir)*rec.t;
+        si.normal = iW.transpose_vector(normalize(p)); // Normals go through the inverse transpose
+    }
+    si.normal = normalize(si.normal);
+    return si;
+}
 
-    for(int nsph=0; nsph<Renderables.objects.len; nsph++)
-    //for(int nsph=0; nsph<1; nsph++)
+// Any-hit query for shadow rays: is there anything (other than entity skip_id)
+// within t_max along dir? Stops at the first blocker instead of finding the closest,
+// and never builds hit positions or normals.
+bool occluded_linear(const vec<float,3> &pos, const vec<float,3> &dir, float t_max,
+    const scene_geometry &geo, int skip_id)
+{
+    const std::vector<render_object> &objects = geo.scene.objects;
+    for(int nsph=0; nsph<int(objects.size()); nsph++)
     {
-        if(src_id == Renderables.objects.items[nsph].entity)
+        if(skip_id == objects[nsph].entity)
             continue;
-        
-        if(Renderables.objects.items[nsph].type != L"sphere")
+        if(!traceable(objects[nsph].type))
             continue;
 
-        vec3 p = mul3_affine(object_mdl_from_world[nsph], pos, 1);
-        vec3 d = mul3_affine(object_mdl_from_world[nsph], dir, 0);
-
-        // Solve t^2 + 2*b*t + c = 0  where b = dot(oc,dir) and c = dot(oc,oc) - r^2
-        //float b = dot(p, d);
-        //float c = dot(p, p) - 1.0f;
-        //float disc = b*b - c;
-        float a = dot(d, d);
-        float b = dot(p, d);
-        float c = dot(p, p) - 1.0f;
-        float disc = b*b - a*c;
-        if (disc < 0.0f) continue; // no real roots -> miss
-
-        float sq = sqrtf(disc);
-        float t0 = (-b - sq)/a;
-        float t1 = (-b + sq)/a;
-
-        // pick nearest positive t (with a small epsilon to avoid self-intersection)
-        const float EPS = 1e-4f;
-        float t = (t0 > EPS) ? t0 : ((t1 > EPS) ? t1 : -1.0f);
-        if (t > 0.0f){// && t < t_min) {
-            // t_min = t;
-            // hit = true;
-            p += d*t;
-            vec3 nrml = normalize(p);// + p;
-
-            p = mul3_affine(object_world_from_mdl[nsph], p, 1);
-            //nrml = mul3_affine(nrml, 0, object_world_from_mdl[nsph]);
-            nrml = mul3_affine(nrml, 0, object_mdl_from_world[nsph]);
-            //nrml = mul3_affine(object_world_from_mdl[nsph], nrml, 0);
-            //nrml = normal_world_from_model(nrml, object_world_from_mdl[nsph]);
-            //nrml = mul3_affine(object_world_from_mdl[nsph], nrml, 1);
-            //nrml = normalize(nrml - p);
-
-            //nrml = normal_world_from_model(nrml, object_mdl_from_world[nsph]);
-
-
-            // float t2 = dot(p-pos,p-pos);
-            // if(t2 < t_min*t_min)
-            // {
-            //     hit = Renderables.objects[nsph].entity;
-            //     t_min = std::sqrt(t2);
-            //     hit_normal = normalize(nrml);
-            // }
-
-            float tW = dot(p - pos, dir);  // dir must be normalized
-            //if (tW > EPS && tW < t_min) {
-            if (tW < t_min) {
-                t_min = tW;
-                hit = Renderables.objects.items[nsph].entity;
-                hit_normal = nrml;
-            }
+        ray_stats.object_tests++;
+        float t = object_t(geo, nsph, pos, dir);
+        if(0.0f < t && t < t_max)
+            return true;
+    }
+    return false;
+}
+
+bool occluded_simd(const vec<float,3> &pos, const vec<float,3> &dir, float t_max,
+    const scene_geometry &geo, int skip_id)
+{
+    ray_stats.object_tests += std::uint64_t(geo.spheres.count);
+    return sphere_soa_any(geo.spheres, 0, geo.spheres.count, pos, dir, skip_id, t_max);
+}
 
+bool occluded_bvh(const vec<float,3> &pos, const vec<float,3> &dir, float t_max,
+    const scene_geometry &geo, int skip_id)
+{
+    return geo.accel.traverse_any(pos, dir, t_max, [&](int first, int count, float t_max)
+    {
+        ray_stats.object_tests += std::uint64_t(count);
+        return sphere_soa_any(geo.spheres, first, first + count, pos, dir, skip_id, t_max);
+    });
+}
 
+bool occluded(const vec<float,3> &origin, const vec<float,3> &dir0, float t_max,
+    const scene_geometry &geo, int skip_id=-2)
+{
+    vec<float,3> dir = normalize(dir0);
+    bool blocked = false;
+    switch(geo.backend)
+    {
+        case TRAVERSE_LINEAR: blocked = occluded_linear(origin, dir, t_max, geo, skip_id); break;
+        case TRAVERSE_SIMD:   blocked = occluded_simd(origin, dir, t_max, geo, skip_id); break;
+        case TRAVERSE_BVH:    blocked = occluded_bvh(origin, dir, t_max, geo, skip_id); break;
+    }
+    ray_stats.shadow++;
+    ray_stats.shadow_blocked += blocked;
+    return blocked;
+}
+
+// Packet traversal: results[lane] for every live lane, as traverse() would give.
+void traverse_packet(ray_packet &pk, const scene_geometry &geo, hit_record *results)
+{
+    switch(geo.backend)
+    {
+        case TRAVERSE_LINEAR:
+            for(int lane=0; lane<SIMD_WIDTH; lane++)
+                if(pk.active >> lane & 1)
+                    results[lane] = traverse_linear(pk.org(lane), pk.dir(lane), geo, int(pk.skip[lane]));
+            break;
+        case TRAVERSE_SIMD:
+            ray_stats.object_tests += std::uint64_t(geo.spheres.count*std::popcount(unsigned(pk.active)));
+            sphere_soa_closest(geo.spheres, 0, geo.spheres.count, pk);
+            break;
+        case TRAVERSE_BVH:
+            geo.accel.traverse_closest(pk, [&](int first, int count, ray_packet &pk)
+            {
+                ray_stats.object_tests += std::uint64_t(count*std::popcount(unsigned(pk.active)));
+                sphere_soa_closest(geo.spheres, first, first + count, pk);
+            });
+            break;
+    }
+
+    if(geo.backend == TRAVERSE_LINEAR) return;
+    for(int lane=0; lane<SIMD_WIDTH; lane++)
+    {
+        if(!(pk.active >> lane & 1) || pk.prim[lane] < 0) continue;
+        results[lane].t = pk.t_max[lane];
+        results[lane].object = geo.spheres.object[pk.prim[lane]];
+    }
+}
+
+int occluded_packet_lanes(const ray_packet &pk, const scene_geometry &geo)
+{
+    switch(geo.backend)
+    {
+        case TRAVERSE_LINEAR:
+        {
+            int blocked = 0;
+            for(int lane=0; lane<SIMD_WIDTH; lane++)
+                if(pk.active >> lane & 1)
+                    if(occluded_linear(pk.org(lane), pk.dir(lane), pk.t_max[lane], geo, int(pk.skip[lane])))
+                        blocked |= 1 << lane;
+            return blocked;
         }
+        case TRAVERSE_SIMD:
+            ray_stats.object_tests += std::uint64_t(geo.spheres.count*std::popcount(unsigned(pk.active)));
+            return sphere_soa_any(geo.spheres, 0, geo.spheres.count, pk, pk.active);
+        case TRAVERSE_BVH:
+            return geo.accel.traverse_any(pk, [&](int first, int count, int live)
+            {
+                ray_stats.object_tests += std::uint64_t(count*std::popcount(unsigned(live)));
+                return sphere_soa_any(geo.spheres, first, first + count, pk, live);
+            });
     }
+    return 0;
+}
 
-    traverse_result result;
-    result.hit = hit;
-    result.dist = t_min;
-    result.hit_normal = normalize(hit_normal);
-    return result;
+// Packet any-hit. Returns the live lanes that are blocked.
+int occluded_packet(const ray_packet &pk, const scene_geometry &geo)
+{
+    int blocked = occluded_packet_lanes(pk, geo);
+    ray_stats.shadow += std::uint64_t(std::popcount(unsigned(pk.active)));
+    ray_stats.shadow_blocked += std::uint64_t(std::popcount(unsigned(blocked)));
+    return blocked;
 }
 
 vec<float,3> phong(
@@ -552,14 +557,12 @@ vec<float,3> phong(
     return mag(Light)*lerp(diffuse, spec, metalness);
 }
 
+// mat comes from the baked scene: linear colors, normalization already computed
 vec<float,3> blinn_phong(
     const vec<float,3> &view,
     const vec<float,3> &Light,
     const vec<float,3> &normal,
-    const vec<float,3> &albedo,
-    const vec<float,3> &spec_color,
-    const vec<float,3> &spec_power,
-    const vec<float,3> &metalness
+    const render_material &mat
 ){
     typedef vec<float,3> vec3;
 
@@ -579,122 +582,580 @@ vec<float,3> blinn_phong(
     float nDotH   = std::max(0.0f, dot(N, H));
 
     // specular term using Blinn-Phong (raise n·h to specular power)
-    vec3 blinn_spec = pow(vec3(nDotH), spec_power);
-    vec3 diffuse = albedo * lambert;
+    vec3 blinn_spec = pow(vec3(nDotH), mat.spec_power);
+    vec3 diffuse = mat.albedo * lambert;
 
-    vec3 bs_normalizer = (spec_power+2.0f)*(spec_power+4.0f)/(8.0f*3.141592f*(pow(2.0f, -spec_power/2.0f) + spec_power));
-    //vec3 bs_normalizer = (spec_power+8.0f)/8.0f;
-    vec3 spec = spec_color * blinn_spec * bs_normalizer;// * (spec_power + 2.0f) / 2.0f;
+    vec3 spec = mat.spec_color * blinn_spec * mat.spec_norm;// * (spec_power + 2.0f) / 2.0f;
 
-    return mag(Light)*lerp(diffuse, spec, metalness);
+    return mag(Light)*lerp(diffuse, spec, mat.metalness);
 }
 
-// GLSL-inspired RGB<->HSV helpers adapted to the project's vec<T,N> types.
-// Source algorithm originally from: https://stackoverflow.com/questions/15095909/from-rgb-to-hsv-in-opengl-glsl
-// Implemented using vec<float,3> and small helpers from vec.hpp.
-vec<float,3> rgb2hsv(const vec<float,3>& rgb)
-{
-    // rgb components in [0,1]
-    float r = rgb[0];
-    float g = rgb[1];
-    float b = rgb[2];
-
-    float mx = std::max(r, std::max(g, b));
-    float mn = std::min(r, std::min(g, b));
-    float d = mx - mn;
-
-    float h = 0.0f;
-    if (d > 1e-10f) {
-        if (mx == r) {
-            h = fmodf((g - b) / d, 6.0f);
-        } else if (mx == g) {
-            h = (b - r) / d + 2.0f;
-        } else {
-            h = (r - g) / d + 4.0f;
+template<typename T, std::size_t N>
+void print_vec(const std::wstring &name, const vec<T,N> &v)
+{
+    std::wcout << name;
+    std::wprintf(L":");
+    for (int c = 0; c < N; ++c)
+    {
+        if(c+1 != N)
+            std::wprintf(L"%10.4f, ", static_cast<double>(v[c]));
+        else
+            std::wprintf(L"%10.4f ", static_cast<double>(v[c]));
+    }
+    std::wprintf(L"\n");
+}
+
+// Everything a render thread needs to shade a pixel. Read-only once rendering starts.
+struct render_context
+{
+    const camera &cam;
+    const render_scene &scene;
+    const scene_geometry &geo;
+    const sampler &samples; // Pixel jitter is dimension pair 0
+    vec<float,3> pos;
+    vec<float,9> View_tf;
+    float ws, hs;
+    int spp_lim;
+    bool packets; // Trace SIMD_WIDTH neighbouring pixels together
+    float adaptive_threshold; // Relative error a pixel stops at, 0 samples every pixel spp_lim times
+    int adaptive_min_spp;     // Samples taken before a pixel may stop
+    std::chrono::steady_clock::time_point deadline; // No pass starts that would end past it; max() for none
+};
+
+const int TILE_SIZE = 16;
+const int TIME_BUDGET_MAX_SPP = 1 << 20; // spp cap for --time-budget without --spp
+
+// Jittered camera ray direction through pixel (iu,iv).
+// The sampler is keyed on (pixel, spp), so the result doesn't depend on which thread runs it.
+vec<float,3> camera_dir(const render_context &ctx, int iu, int iv, int spp)
+{
+    typedef vec<float,3> vec3;
+    const camera &cam = ctx.cam;
+
+    float jitter[2];
+    ctx.samples.get2d(iu, iv, std::uint32_t(spp), 0, jitter);
+
+    float v = (jitter[1] + float(iv) + 0.5f)/cam.h; // Adds 0.5f so the pixel is centered
+    v = v*2.0f - 1.0f;
+    v *= -ctx.hs;
+
+    float u = (jitter[0] + float(iu) + 0.5f)/cam.w;
+    u = u*2.0f - 1.0f;
+    u *= ctx.ws;
+
+    vec3 dir = vec3{u,v,1.0f};
+    dir = normalize(dir);
+    return normalize(mul(ctx.View_tf, dir));
+}
+
+// Shades a camera ray's hit, returning linear radiance. Shadow rays toward
+// directional lights are the caller's job: direct_visible(n) says whether
+// scene.direct_lights[n] is unblocked, so packets can answer it from a batched test.
+template<typename DirectVisible>
+vec<float,3> shade(const render_context &ctx, const vec<float,3> &dir,
+    const surface_interaction &si, DirectVisible &&direct_visible)
+{
+    typedef vec<float,3> vec3;
+    const render_scene &scene = ctx.scene;
+
+    int hit = si.entity;
+    const vec3 &hit_pos = si.position;
+    const vec3 &hit_normal = si.normal;
+    vec3 color = scene.ambient;//vec3{0.0f};
+
+    if (0 <= hit) do {
+        int mid = si.material;
+        if(mid < 0)
+        {
+            hit = -1;
+            break;
+        }
+        const render_material &mat = scene.materials[mid];
+        vec3 view = normalize(dir);
+
+        // Ambient lights, all folded into one term at bake time
+        color = scene.ambient_light*mat.ambient_reflect;
+
+        for(std::size_t n=0; n<scene.direct_lights.size(); n++)
+        {
+            const direct_light &Light = scene.direct_lights[n];
+            if(direct_visible(int(n))) // we WANT this ray to miss!
+            {
+                vec3 L = Light.L*Light.radiance;
+                color += blinn_phong(view, L, hit_normal, mat);
+            }
+        }
+
+        for(const point_light &Light : scene.point_lights)
+        {
+            vec3 dL = Light.position - hit_pos;
+            float dl2 = dot(dL,dL);
+            vec3 L = normalize(dL);// * Light.intensity;
+
+            // Only blockers between the surface and the light count
+            if(!occluded(hit_pos, L, std::sqrt(dl2), ctx.geo, hit))
+            {
+                L *= Light.radiance;///dl2;
+                vec3 color_new = blinn_phong(view, L, hit_normal, mat);
+                color += color_new*100.0f/dl2;
+            }
         }
-        h /= 6.0f; // normalize to [0,1)
-        if (h < 0.0f) h += 1.0f;
+    } while(false);
+
+    //float cblnd = exp(-0.1*dist);
+    //color = color*cblnd + (1.0-cblnd)*ambient;
+
+    return max(color, vec3{0});
+}
+
+// One jittered camera ray through pixel (iu,iv), shaded.
+vec<float,3> render_sample(const render_context &ctx, int iu, int iv, int spp)
+{
+    vec<float,3> dir = camera_dir(ctx, iu, iv, spp);
+    surface_interaction si = surface_at(ctx.geo, ctx.pos, dir, traverse(ctx.pos, dir, ctx.geo));
+    ray_stats.primary++;
+    ray_stats.hits += (0 <= si.entity);
+    return shade(ctx, dir, si, [&](int n)
+    {
+        return !occluded(si.position, ctx.scene.direct_lights[n].L, 1e30f, ctx.geo, si.entity);
+    });
+}
+
+// Pixels iu0 .. iu0+count-1 of row iv (count <= SIMD_WIDTH) as one camera packet.
+// Shadow rays toward each directional light go out as one packet too; point lights
+// stay per ray since their directions diverge.
+void render_packet(const render_context &ctx, int iu0, int count, int iv, int spp,
+    vec<float,3> *colors)
+{
+    typedef vec<float,3> vec3;
+    const render_scene &scene = ctx.scene;
+
+    vec3 dirs[SIMD_WIDTH];
+    ray_packet primary;
+    for(int lane=0; lane<count; lane++)
+    {
+        dirs[lane] = camera_dir(ctx, iu0 + lane, iv, spp);
+        primary.set(lane, ctx.pos, dirs[lane], 1e30f, -2);
+    }
+
+    hit_record results[SIMD_WIDTH];
+    traverse_packet(primary, ctx.geo, results);
+
+    surface_interaction si[SIMD_WIDTH];
+    for(int lane=0; lane<count; lane++)
+    {
+        si[lane] = surface_at(ctx.geo, ctx.pos, dirs[lane], results[lane]);
+        ray_stats.hits += (0 <= si[lane].entity);
     }
+    ray_stats.primary += std::uint64_t(count);
 
-    float s = (mx <= 1e-10f) ? 0.0f : (d / mx);
-    float v = mx;
+    // blocked[n] holds the lanes whose shadow ray toward direct light n is blocked
+    thread_local std::vector<int> blocked;
+    blocked.assign(scene.direct_lights.size(), 0);
+    for(std::size_t n=0; n<scene.direct_lights.size(); n++)
+    {
+        ray_packet shadow;
+        for(int lane=0; lane<count; lane++)
+            if(0 <= si[lane].entity)
+                shadow.set(lane, si[lane].position, scene.direct_lights[n].L, 1e30f, si[lane].entity);
+        blocked[n] = occluded_packet(shadow, ctx.geo);
+    }
 
-    return vec<float,3>{h, s, v};
+    for(int lane=0; lane<count; lane++)
+    {
+        colors[lane] = shade(ctx, dirs[lane], si[lane], [&](int n)
+        {
+            return !(blocked[std::size_t(n)] >> lane & 1);
+        });
+    }
 }
 
-vec<float,3> hsv2rgb(const vec<float,3>& hsv)
+// Standard error of the mean luminance against threshold, with a floor so
+// near-black pixels don't chase a relative error on nothing.
+bool pixel_converged(const render_context &ctx, const accumulation &acc, std::size_t p)
 {
-    float h = hsv[0];
-    float s = hsv[1];
-    float v = hsv[2];
+    int n = acc.count[p];
+    if(n < ctx.adaptive_min_spp || n < 2) return false;
+    float err = ctx.adaptive_threshold*std::max(acc.mean[p], 0.01f);
+    return acc.m2[p] <= err*err*float(n)*float(n - 1);
+}
 
-    // h in [0,1), scale to [0,6)
-    float hh = h * 6.0f;
-    int i = int(std::floor(hh)) % 6; // sector 0..5
-    float f = hh - std::floor(hh);
+// This thread's ray counts and the clock when a sample started, for --heatmap
+struct cost_probe
+{
+    ray_counters rays{};
+    std::chrono::steady_clock::time_point start;
 
-    float p = v * (1.0f - s);
-    float q = v * (1.0f - s * f);
-    float t = v * (1.0f - s * (1.0f - f));
+    void begin()
+    {
+        rays = ray_stats;
+        start = std::chrono::steady_clock::now();
+    }
+};
+
+// Adds samples [spp0,spp1) of a tile into the running sums, then writes the
+// tile's average so far into its (disjoint) region of the backbuffer. Each
+// pixel still sums its samples in order, so splitting the render into passes
+// gives the same image as doing it in one go. With adaptive sampling, pixels
+// that have converged are skipped (packets keep going while any lane hasn't),
+// and the return value says whether anything in the tile still wants samples.
+bool render_tile(const render_context &ctx, const tile &t, int spp0, int spp1,
+    accumulation &acc, std::vector<float> &backbuffer)
+{
+    bool adaptive = ctx.adaptive_threshold > 0.0f;
+    bool profile = !acc.cost.empty();
+    auto add = [&](int iu, int iv, const vec<float,3> &color)
+    {
+        std::size_t p = acc.index(iu, iv);
+        acc.sum[p*3 + 0] += color[0];
+        acc.sum[p*3 + 1] += color[1];
+        acc.sum[p*3 + 2] += color[2];
+        int n = ++acc.count[p];
+        if(adaptive)
+        {
+            float y = 0.2126f*color[0] + 0.7152f*color[1] + 0.0722f*color[2];
+            float d = y - acc.mean[p];
+            acc.mean[p] += d/float(n);
+            acc.m2[p] += d*(y - acc.mean[p]);
+        }
+    };
+    // What a sample cost since probe, split evenly over the count pixels that shared it
+    auto charge = [&](int iu, int iv, int count, const cost_probe &probe)
+    {
+        float share = 1.0f/float(count);
+        float tests = float(ray_stats.object_tests - probe.rays.object_tests)*share;
+        float shadow = float(ray_stats.shadow - probe.rays.shadow)*share;
+        float ns = float(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - probe.start).count())*share;
+        std::size_t p = acc.index(iu, iv);
+        for(int k=0; k<count; k++)
+        {
+            acc.cost[(p + std::size_t(k))*3 + 0] += tests;
+            acc.cost[(p + std::size_t(k))*3 + 1] += shadow;
+            acc.cost[(p + std::size_t(k))*3 + 2] += ns;
+        }
+    };
+    auto active = [&](int iu, int iv, int count)
+    {
+        if(!adaptive) return true;
+        std::size_t p = acc.index(iu, iv);
+        for(int k=0; k<count; k++)
+            if(!pixel_converged(ctx, acc, p + std::size_t(k)))
+                return true;
+        return false;
+    };
 
-    switch (i) {
-        case 0: return vec<float,3>{v, t, p};
-        case 1: return vec<float,3>{q, v, p};
-        case 2: return vec<float,3>{p, v, t};
-        case 3: return vec<float,3>{p, q, v};
-        case 4: return vec<float,3>{t, p, v};
-        case 5: default: return vec<float,3>{v, p, q};
+    bool any_active = true;
+    for(int spp=spp0; spp<spp1 && any_active; spp++)
+    {
+        any_active = !adaptive;
+        for(int iv=t.y0; iv<t.y1; iv++)
+        {
+            if(ctx.packets)
+            {
+                for(int iu=t.x0; iu<t.x1; iu+=SIMD_WIDTH)
+                {
+                    int count = std::min(SIMD_WIDTH, t.x1 - iu);
+                    if(!active(iu, iv, count)) continue;
+                    vec<float,3> colors[SIMD_WIDTH];
+                    cost_probe probe;
+                    if(profile) probe.begin();
+                    render_packet(ctx, iu, count, iv, spp, colors);
+                    if(profile) charge(iu, iv, count, probe);
+                    for(int lane=0; lane<count; lane++)
+                        add(iu + lane, iv, colors[lane]);
+                    any_active = any_active || active(iu, iv, count);
+                }
+            }
+            else
+            {
+                for(int iu=t.x0; iu<t.x1; iu++)
+                {
+                    if(!active(iu, iv, 1)) continue;
+                    cost_probe probe;
+                    if(profile) probe.begin();
+                    vec<float,3> color = render_sample(ctx, iu, iv, spp);
+                    if(profile) charge(iu, iv, 1, probe);
+                    add(iu, iv, color);
+                    any_active = any_active || active(iu, iv, 1);
+                }
+            }
+        }
     }
+
+    acc.average(t, backbuffer);
+    return any_active;
 }
 
-vec<float,3> saturationClip(const vec<float,3>& rgb)
+// Renders up to ctx.spp_lim samples per pixel in passes of pass_spp, into an
+// acc already set up to cover the tiles and holding spp_start samples per pixel
+// (more than 0 when resuming). After every pass the backbuffer holds the
+// average so far and is handed to preview (if any). Tiles whose pixels have
+// all converged drop out of later passes. cancel is checked between passes;
+// returns false if it stopped the render. Running into ctx.deadline also stops
+// it between passes, but counts as finished. With a checkpoint schedule, acc
+// is saved between passes as it asks and once more on the way out.
+bool render_progressive(const render_context &ctx, const std::vector<tile> &tiles, tile_pool &pool,
+    int pass_spp, int spp_start, accumulation &acc, std::vector<float> &backbuffer,
+    preview_buffer *preview, checkpoint_schedule *checkpoint, const std::atomic<bool> &cancel)
 {
-    vec<float,3> hsv = rgb2hsv(rgb);
+    std::vector<std::uint8_t> tile_active(tiles.size(), 1);
+    std::vector<tile> pending = tiles;
+    int spp = spp_start;
+    bool timed = ctx.deadline != std::chrono::steady_clock::time_point::max();
+    std::chrono::steady_clock::duration last_pass{0};
+    int saved_spp = spp_start;
+    auto save = [&]()
+    {
+        checkpoint->info.spp = spp;
+        std::wstring err = write_checkpoint(checkpoint->path, checkpoint->info, acc);
+        if(err != L"")
+            std::wcout << L"Error writing checkpoint " << std::filesystem::path(checkpoint->path).wstring()
+                       << L": " << err << std::endl;
+        checkpoint->last = std::chrono::steady_clock::now();
+        saved_spp = spp;
+    };
 
-    // If v (value) exceeds 1.0, scale down saturation and value so v==1
-    if (hsv[2] > 1.0f) {
-        float scale = 1.0f / hsv[2];
-        hsv[1] *= scale;
-        hsv[2] = 1.0f;
+    if(spp > 0)
+    {
+        // Resumed: show what the checkpoint already has, even if no pass is left to run
+        for(const tile &t : tiles)
+            acc.average(t, backbuffer);
+        if(preview)
+            preview->publish(backbuffer, spp);
     }
 
-    return hsv2rgb(hsv);
+    while(spp < ctx.spp_lim && !pending.empty() && !cancel)
+    {
+        // Out of time budget: skip the pass if the last one says it would overrun.
+        // The first always runs so every pixel has a sample.
+        auto pass_start = std::chrono::steady_clock::now();
+        if(timed && spp > 0 && pass_start + last_pass > ctx.deadline)
+            break;
+
+        int spp1 = std::min(ctx.spp_lim, spp + pass_spp);
+        TRACE_SCOPE_ARG("pass", spp);
+        pool.run(pending, [&](const tile &t, int tid)
+        {
+            TRACE_SCOPE_ARG("tile", t.id);
+            tile_active[std::size_t(t.id)] = render_tile(ctx, t, spp, spp1, acc, backbuffer);
+        });
+        spp = spp1;
+        last_pass = std::chrono::steady_clock::now() - pass_start;
+        if(preview)
+            preview->publish(backbuffer, spp);
+
+        pending.clear();
+        for(const tile &t : tiles)
+            if(tile_active[std::size_t(t.id)])
+                pending.push_back(t);
+
+        if(checkpoint && std::chrono::duration<double>(std::chrono::steady_clock::now() - checkpoint->last).count() >= checkpoint->interval)
+            save();
+    }
+    if(checkpoint && spp != saved_spp)
+        save();
+    return spp >= ctx.spp_lim || pending.empty() || (timed && !cancel);
 }
 
-template<typename T, std::size_t N>
-void print_vec(const std::wstring &name, const vec<T,N> &v)
+void log_adaptive_samples(const render_context &ctx, std::uint64_t samples)
 {
-    std::wcout << name;
-    std::wprintf(L":");
-    for (int c = 0; c < N; ++c)
+    if(ctx.adaptive_threshold <= 0.0f || ctx.deadline != std::chrono::steady_clock::time_point::max()) return;
+    double pixels = double(ctx.cam.w)*double(ctx.cam.h);
+    std::wcout << L"Adaptive sampling: " << samples << L" samples, " << double(samples)/pixels
+               << L" spp on average (cap " << ctx.spp_lim << L", "
+               << 100.0*double(samples)/(pixels*double(ctx.spp_lim)) << L"% of the fixed-rate cost)" << std::endl;
+}
+
+// What a --time-budget render got done: samples per pixel and where the time went
+void log_time_budget(const render_context &ctx, const accumulation &acc, std::chrono::steady_clock::time_point run_start)
+{
+    if(ctx.deadline == std::chrono::steady_clock::time_point::max()) return;
+    auto [lo, hi] = std::minmax_element(acc.count.begin(), acc.count.end());
+    double mean = double(acc.samples())/double(acc.count.size());
+    double budget = std::chrono::duration<double>(ctx.deadline - run_start).count();
+    double used = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    std::wcout << L"Time budget " << budget << L" s, used " << used << L" s: " << mean
+               << L" spp per pixel on average (min " << *lo << L", max " << *hi << L")" << std::endl;
+}
+
+// Renders the frame one band of TILE_SIZE rows at a time and hands each band to
+// the stream as soon as it is done, so memory is bounded by a band rather than
+// the image. The band's tiles still spread over all threads.
+int render_streaming(const render_context &ctx, tile_pool &pool, image_stream &stream)
+{
+    const camera &cam = ctx.cam;
+    accumulation acc;
+    std::vector<float> band;
+    std::atomic<bool> cancel{false};
+    std::uint64_t samples = 0;
+    for(int y0=0; y0<cam.h; y0+=TILE_SIZE)
     {
-        if(c+1 != N)
-            std::wprintf(L"%10.4f, ", static_cast<double>(v[c]));
-        else
-            std::wprintf(L"%10.4f ", static_cast<double>(v[c]));
+        int rows = std::min(TILE_SIZE, cam.h - y0);
+        std::vector<tile> tiles = make_tiles(cam.w, rows, TILE_SIZE);
+        for(tile &t : tiles)
+        {
+            t.y0 += y0;
+            t.y1 += y0;
+        }
+
+        acc.init(cam.w, y0, rows, ctx.adaptive_threshold > 0.0f);
+        band.assign(acc.sum.size(), 0.0f);
+        render_progressive(ctx, tiles, pool, ctx.spp_lim, 0, acc, band, nullptr, nullptr, cancel);
+        samples += acc.samples();
+
+        std::wstring err = stream.write_rows(y0, rows, band.data());
+        if(err != L"")
+        {
+            std::wcout << L"Error streaming rows " << y0 << L".." << y0 + rows << L": " << err << std::endl;
+            return -1;
+        }
     }
-    std::wprintf(L"\n");
+    log_adaptive_samples(ctx, samples);
+    return 0;
 }
 
-int main(int argc, wchar_t** argv) {
-    _setmode(_fileno(stdout), _O_U16TEXT);
+// Set by the window closing, or by SIGINT/SIGTERM when checkpointing
+std::atomic<bool> stop_requested{false};
 
-    //std::array<float,3> fuck;
-    //fuck.data
+extern "C" void on_stop_signal(int)
+{
+    stop_requested = true;
+}
+
+int main(int argc, char** argv) {
+    // A --time-budget counts from here, scene loading included
+    auto run_start = std::chrono::steady_clock::now();
+    ray_stats_scope main_rays; // Also the display thread in the GUI
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_U16TEXT);
+#endif
 
     //std::wstring path =  L"./scenes/scene_00.xml";
     //std::wstring path =  L"./scenes/scene_01.xml";
     //std::wstring path =  L"./scenes/project_2_scene.xml";
     std::wstring path =  L"./scenes/project_3_scene.xml";
+    int camera_index = 0;
+    int width = 0, height = 0; // 0 keeps the camera's own resolution
+    int spp_lim = 16;
+    std::vector<std::string> outputs; // .pfm, .ppm or .png
+    std::string stream_path;          // .pfm or .half, written band by band
+    std::string stats_path;           // JSON stage timings and ray counters, written on exit
+#ifdef UTAH_TRACE
+    std::string trace_path;           // Chrome trace_event JSON, written on exit
+#endif
+    std::string heatmap_base;         // Per-pixel cost, base.pfm raw and base.png false color
+    heatmap_metric heatmap_kind = HEATMAP_TIME;
+    std::string checkpoint_path;      // Saved every checkpoint_every seconds
+    std::string resume_path;          // Checkpoint to continue from
+    double checkpoint_every = 300.0;
+    double time_budget = 0.0;         // Seconds, 0 renders until --spp
+    bool spp_given = false;
+#ifdef UTAH_HEADLESS
+    bool headless = true;
+#else
+    bool headless = false;
+#endif
+
+    int threads = default_thread_count();
+    std::uint32_t seed = 0;
+    traverse_backend backend = TRAVERSE_BVH;
+    bool packets = true;
+    sampler_type sampler_kind = SAMPLER_RANDOM;
+    std::string accel_name = "bvh", sampler_name = "random"; // For --stats
+    transfer_curve curve = TRANSFER_GAMMA22;
+    float adaptive_threshold = 0.0f;
+    int adaptive_min_spp = 8;
+    for(int n=1; n<argc; n++)
+    {
+        std::string arg = argv[n];
+        if(arg == "--threads" && n+1 < argc)
+            threads = std::max(1, std::atoi(argv[++n]));
+        else if(arg == "--seed" && n+1 < argc)
+            seed = std::uint32_t(std::strtoul(argv[++n], nullptr, 10));
+        else if(arg == "--accel" && n+1 < argc)
+        {
+            std::string name = argv[++n];
+            if(name == "linear") backend = TRAVERSE_LINEAR;
+            else if(name == "simd") backend = TRAVERSE_SIMD;
+            else if(name == "bvh") backend = TRAVERSE_BVH;
+            else std::wcout << L"Unknown --accel backend, using bvh" << std::endl;
+            if(name == "linear" || name == "simd") accel_name = name;
+        }
+        else if(arg == "--transfer" && n+1 < argc)
+        {
+            if(!parse_transfer_curve(argv[++n], curve))
+                std::wcout << L"Unknown --transfer curve, using gamma" << std::endl;
+        }
+        else if(arg == "--sampler" && n+1 < argc)
+        {
+            if(parse_sampler_type(argv[++n], sampler_kind))
+                sampler_name = argv[n];
+            else
+                std::wcout << L"Unknown --sampler, using random" << std::endl;
+        }
+        else if(arg == "--no-packets")
+            packets = false;
+        else if(arg == "--adaptive" && n+1 < argc)
+            adaptive_threshold = std::max(0.0f, float(std::atof(argv[++n])));
+        else if(arg == "--min-spp" && n+1 < argc)
+            adaptive_min_spp = std::max(2, std::atoi(argv[++n]));
+        else if(arg == "--scene" && n+1 < argc)
+            path = std::filesystem::path(argv[++n]).wstring();
+        else if(arg == "--camera" && n+1 < argc)
+            camera_index = std::max(0, std::atoi(argv[++n]));
+        else if(arg == "--width" && n+1 < argc)
+            width = std::max(0, std::atoi(argv[++n]));
+        else if(arg == "--height" && n+1 < argc)
+            height = std::max(0, std::atoi(argv[++n]));
+        else if(arg == "--spp" && n+1 < argc)
+        {
+            spp_lim = std::max(1, std::atoi(argv[++n]));
+            spp_given = true;
+        }
+        else if(arg == "--time-budget" && n+1 < argc)
+            time_budget = std::max(0.0, std::atof(argv[++n]));
+        else if(arg == "--out" && n+1 < argc)
+            outputs.push_back(argv[++n]);
+        else if(arg == "--stream" && n+1 < argc)
+            stream_path = argv[++n];
+        else if(arg == "--checkpoint" && n+1 < argc)
+            checkpoint_path = argv[++n];
+        else if(arg == "--checkpoint-every" && n+1 < argc)
+            checkpoint_every = std::max(1.0, std::atof(argv[++n]));
+        else if(arg == "--resume" && n+1 < argc)
+            resume_path = argv[++n];
+        else if(arg == "--stats" && n+1 < argc)
+            stats_path = argv[++n];
+#ifdef UTAH_TRACE
+        else if(arg == "--trace" && n+1 < argc)
+            trace_path = argv[++n];
+#endif
+        else if(arg == "--heatmap" && n+1 < argc)
+            heatmap_base = argv[++n];
+        else if(arg == "--heatmap-metric" && n+1 < argc)
+        {
+            if(!parse_heatmap_metric(argv[++n], heatmap_kind))
+                std::wcout << L"Unknown --heatmap-metric, using time" << std::endl;
+        }
+        else if(arg == "--headless")
+            headless = true;
+        else
+            std::wcout << L"Unknown argument: " << std::filesystem::path(arg).wstring() << std::endl;
+    }
+
+    //std::array<float,3> fuck;
+    //fuck.data
 
-    std::vector<xml_component> components;
-    std::wstring result = read_xml(components, path);
+    stage_timer parse_timer("read_xml");
+    xml_document doc;
+    std::wstring result = read_xml(doc, path);
+    parse_timer.stop();
     if (result != L"")
     {
         std::wcout << "Error reading XML: " << result << std::endl;
         return -1;
     }
-    std::wcout << pprint_components(components);
+    std::wcout << pprint_components(doc.components);
 
     //return sdl_test_01();
     //return sdl_test_02();
@@ -702,11 +1163,19 @@ int main(int argc, wchar_t** argv) {
 
     //decode_xml_components(components);
     renderables Renderables;
-    init_renderables(Renderables, components);
+    stage_timer compile_timer("init_renderables");
+    init_renderables(Renderables, doc.components);
+    compile_timer.stop();
     dump_renderables(Renderables, /*max_items=*/16);
     
-    const camera &cam = Renderables.cameras[0];
-    std::vector<float> backbuffer(std::size_t(cam.h*cam.w*3), 0.0f);
+    if(camera_index >= Renderables.cameras.len)
+    {
+        std::wcout << L"Scene has no camera " << camera_index << std::endl;
+        return -1;
+    }
+    camera cam = Renderables.cameras[camera_index];
+    if(width > 0) cam.w = width;
+    if(height > 0) cam.h = height;
     const float π = 3.141592653589793; // via mathematica
     float θ = cam.fov_deg * (π / 180.0f) / 2.0f;
     float zs = std::atan(θ);
@@ -760,11 +1229,9 @@ int main(int argc, wchar_t** argv) {
         }
         std::wprintf(L"\n");
     
-    using mat4 = vec<float,16>;
-    using vec4 = vec<float,4>;
-
-    std::vector<mat4> object_world_from_mdl;
-    std::vector<mat4> object_mdl_from_world;
+    stage_timer transform_timer("transforms");
+    std::vector<affine3x4> object_world_from_mdl;
+    std::vector<affine3x4> object_mdl_from_world;
 
     object_world_from_mdl.resize(Renderables.objects.len);
     object_mdl_from_world.resize(Renderables.objects.len);
@@ -773,8 +1240,8 @@ int main(int argc, wchar_t** argv) {
     {
         object &start = Renderables.objects.items[nsph];
 
-        mat4 W  = identity<4>();
-        mat4 iW = identity<4>();
+        affine3x4 W  = affine3x4::identity();
+        affine3x4 iW = affine3x4::identity();
 
         int eid = start.entity;
         //std::wcout << L"eid:" << eid << L" pid:" << cur.parent << L", ";
@@ -791,20 +1258,20 @@ int main(int argc, wchar_t** argv) {
 
             object &cur = Renderables.objects.items[idx];
 
-            mat4 L  = local_model_to_parent(cur);
-            mat4 iL = local_parent_to_model(cur);
+            affine3x4 L, iL;
+            local_transforms(cur, L, iL);
 
-            W  = mul44_44(L, W);     // prepend
-            iW = mul44_44(iW, iL);   // append (this is the key!)
+            W  = L*W;     // prepend
+            iW = iW*iL;   // append (this is the key!)
 
             eid = cur.parent;
             std::wcout << L"eid:" << eid << L" ";
         }
         std::wcout << std::endl;
 
-        // Pretty-print W and iW (row-major 4x4)
+        // Pretty-print W and iW (row-major 3x4, the 0 0 0 1 row is implied)
         std::wprintf(L"object %d (entity %d) world_from_model (W):\n", nsph, start.entity);
-        for (int r = 0; r < 4; ++r) {
+        for (int r = 0; r < 3; ++r) {
             std::wprintf(L"  ");
             for (int c = 0; c < 4; ++c) {
                 std::wprintf(L"%10.4f ", static_cast<double>(W[r*4 + c]));
@@ -812,7 +1279,7 @@ int main(int argc, wchar_t** argv) {
             std::wprintf(L"\n");
         }
         std::wprintf(L"object %d model_from_world (iW):\n", nsph);
-        for (int r = 0; r < 4; ++r) {
+        for (int r = 0; r < 3; ++r) {
             std::wprintf(L"  ");
             for (int c = 0; c < 4; ++c) {
                 std::wprintf(L"%10.4f ", static_cast<double>(iW[r*4 + c]));
@@ -824,163 +1291,251 @@ int main(int argc, wchar_t** argv) {
         object_world_from_mdl[nsph] = W;
         object_mdl_from_world[nsph] = iW;
     }
+    transform_timer.stop();
+
+    // Render-only scene; needs the world transforms to spot plain spheres
+    stage_timer build_timer("scene_build");
+    render_scene scene = bake_render_scene(Renderables, object_world_from_mdl);
+    dump_render_scene(scene, /*max_items=*/16);
 
-    // Find the ambient term early
-    vec3 ambient = vec3{0.2f, 0.3f, 0.6f};
-    for(std::size_t n=0; n<Renderables.lights.len; n++)
+    // Acceleration structure over the world bounds of every sphere
+    std::vector<aabb> object_bounds;
+    std::vector<int> object_ids;
+    for (int nsph = 0; nsph < Renderables.objects.len; nsph++)
     {
-        if(Renderables.lights[n].type == L"ambient")
-        {
-            ambient = vec3(Renderables.lights[n].intensity, 3);
-            break;
-        }
+        if(!traceable(scene.objects[nsph].type)) continue;
+        object_bounds.push_back(object_world_bounds(object_world_from_mdl[nsph]));
+        object_ids.push_back(nsph);
     }
-    ambient = pow(ambient, vec3{2.2});
-
-    const int spp_lim = 16;
-    for(int spp=0; spp<spp_lim; spp++)
+    bvh accel;
+    accel.build(object_bounds, object_ids, SIMD_WIDTH);
+    std::wcout << L"BVH: " << accel.nodes.size() << L" nodes over " << accel.prims.size()
+               << L" objects, " << SIMD_WIDTH << L"-wide leaves" << std::endl;
+
+    // SoA copy of the sphere transforms in BVH leaf order
+    std::vector<int> sphere_entities;
+    for(int nsph : accel.prims)
+        sphere_entities.push_back(scene.objects[nsph].entity);
+    sphere_soa spheres;
+    spheres.build(object_mdl_from_world, scene.world_spheres, accel.prims, sphere_entities);
+
+    scene_geometry geo{scene, object_world_from_mdl, object_mdl_from_world, accel, spheres, backend};
+    build_timer.stop();
+
+    sampler samples = make_sampler(sampler_kind, seed, cam.w);
+
+    // With a time budget --spp is only a cap, and there is none unless it was given
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if(time_budget > 0.0 && stream_path.empty())
     {
+        deadline = run_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(time_budget));
+        if(!spp_given)
+            spp_lim = TIME_BUDGET_MAX_SPP;
+    }
+    else if(time_budget > 0.0)
+        std::wcout << L"--time-budget is ignored with --stream" << std::endl;
+
+    render_context ctx{cam, scene, geo, samples,
+        pos, View_tf, ws, hs, spp_lim, packets, adaptive_threshold, adaptive_min_spp, deadline};
 
-    for(int iv=0; iv<cam.h; iv++)
+    // --trace and --stats, on every way out once the render has run
+    auto write_reports = [&]()
     {
-        // float v = (float(iv) + 0.5f)/cam.h; // Adds 0.5f so the pixel is centered
-        // v = v*2.0f - 1.0f;
-        // v *= -hs;
-        for(int iu=0; iu<cam.w; iu++)
+#ifdef UTAH_TRACE
+        if(!trace_path.empty())
         {
-            float v = (xorshiftflt() + float(iv) + 0.5f)/cam.h; // Adds 0.5f so the pixel is centered
-            v = v*2.0f - 1.0f;
-            v *= -hs;
-
-            float u = (xorshiftflt() + float(iu) + 0.5f)/cam.w;
-            u = u*2.0f - 1.0f;
-            u *= ws;
-
-            dir = vec3{u,v,1.0f};
-            dir = normalize(dir);
-            dir = normalize(mul(View_tf, dir));
-
-            // Ray-sphere intersection: find nearest hit (if any)
-            float t_min = 1e30f;
-            int hit = false;
-            vec3 hit_normal{0.0f};
-            vec3 color = ambient;//vec3{0.0f};
-
-            traverse_result tv_res =  traverse(pos, dir, object_world_from_mdl, 
-                object_mdl_from_world, Renderables);
+            std::wstring err = write_trace_json(trace_path);
+            if(err != L"")
+                std::wcout << L"Error writing " << std::filesystem::path(trace_path).wstring() << L": " << err << std::endl;
+        }
+#endif
+        if(stats_path.empty()) return;
+        add_stage_time("total", std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count());
+        stats_run_info run;
+        run.scene = std::filesystem::path(path).string();
+        run.accel = accel_name;
+        run.sampler = sampler_name;
+        run.width = cam.w;
+        run.height = cam.h;
+        run.threads = threads;
+        run.spp = spp_lim;
+        run.packets = packets;
+        std::wstring err = write_stats_json(stats_path, run);
+        if(err != L"")
+            std::wcout << L"Error writing " << std::filesystem::path(stats_path).wstring() << L": " << err << std::endl;
+    };
 
-            hit = tv_res.hit;
-            hit_normal = tv_res.hit_normal;
-            t_min = tv_res.dist;
+    // Every pass and tone map from here on shares these workers
+    tile_pool pool(threads);
 
-            if (0 <= hit) do {
-                // Simple shading: map normal [-1,1] -> [0,1] as color
-                //dir = hit_normal * 0.5f + vec3{0.5f};
+    if(!stream_path.empty())
+    {
+        if(!outputs.empty())
+            std::wcout << L"--out is ignored with --stream, the full frame is never held in memory" << std::endl;
+        if(!checkpoint_path.empty() || !resume_path.empty())
+            std::wcout << L"--checkpoint and --resume are ignored with --stream" << std::endl;
+        if(!heatmap_base.empty())
+            std::wcout << L"--heatmap is ignored with --stream" << std::endl;
+        image_stream stream;
+        std::wstring err = stream.open(stream_path, cam.w, cam.h);
+        if(err != L"")
+        {
+            std::wcout << L"Error opening " << std::filesystem::path(stream_path).wstring() << L": " << err << std::endl;
+            return -1;
+        }
+        std::wcout << L"Streaming " << cam.w << L"x" << cam.h << L" in bands of " << TILE_SIZE
+                   << L" rows on " << threads << L" threads" << std::endl;
+        stage_timer render_timer("render");
+        int status = render_streaming(ctx, pool, stream);
+        render_timer.stop();
+        if(status == 0)
+            std::wcout << L"Wrote " << std::filesystem::path(stream_path).wstring() << std::endl;
+        write_reports();
+        return status;
+    }
 
-                vec3 hit_pos = pos + dir*t_min;
+    if(headless && outputs.empty())
+        std::wcout << L"Headless run with no --out, the image will be discarded" << std::endl;
 
-                // Find object by entitiy id.
-                int sid = search_sorted_index(Renderables.objects.imap_v, Renderables.objects.len, hit);
-                if(sid < 0)
-                {
-                    hit = -1;
-                    break;
-                }
-                int mid = Renderables.objects.items[Renderables.objects.imap_k[sid]].mid;
-                if(mid < 0)
-                {
-                    hit = -1;
-                    break;
-                }
-                material &mat = Renderables.materials.items[mid];
+    std::vector<float> backbuffer(std::size_t(cam.h*cam.w*3), 0.0f);
 
-                vec3 albedo = pow(vec3(mat.albedo,3),vec3{2.2});
-                vec3 spec_color = pow(vec3(mat.spec_color,3),vec3{2.2});
-                vec3 glossiness = vec3(mat.glossiness,3);// * 100.0f;
-                vec3 metalness = vec3(mat.glossiness_value);//vec3(1.0 - mat.glossiness_value);
-                vec3 view = normalize(dir);
+    std::vector<tile> tiles = make_tiles(cam.w, cam.h, TILE_SIZE);
+    std::wcout << L"Rendering " << tiles.size() << L" tiles on " << threads << L" threads" << std::endl;
 
-                // Add on phong filtered ambient
-                color = vec3{0};//ambient*(albedo*(1.0-metalness) + metalness*spec_color);
+    tonemapper tm = make_tonemapper(curve);
+    accumulation acc;
+    acc.init(cam.w, 0, cam.h, adaptive_threshold > 0.0f);
 
-                for(int lid=0; lid < Renderables.lights.len; lid++)
-                {
-                    light &Light = Renderables.lights[lid];
-                    vec3 LLum = pow(vec3(Light.intensity,3), vec3{2.2});
-                    if(Light.type == L"ambient")
-                    {
-                        color += ambient*lerp(albedo, spec_color, metalness);
-                        continue;
-                    } 
-                    if(Light.type == L"direct")
-                    {
-                        vec3 L = -normalize(vec3(Light.direction, 3));// * Light.intensity;
-
-                        traverse_result tv2_res =  traverse(hit_pos, L, object_world_from_mdl, 
-                            object_mdl_from_world, Renderables, hit);
-                        if(tv2_res.hit < 0) // we WANT this ray to miss!
-                        {
-                            L *= LLum;
-                            //color += phong(view, L, hit_normal, albedo, spec_color, glossiness, metalness);
-                            color += blinn_phong(view, L, hit_normal, albedo, spec_color, glossiness, metalness);
-                        }
-                    }
-                    if(Light.type == L"point")
-                    {
-                        vec3 Lx = vec3(Light.position,3);
-                        vec3 dL = Lx - hit_pos;
-                        float dl2 = dot(dL,dL);
-                        vec3 L = normalize(dL);// * Light.intensity;
-
-                        traverse_result tv2_res =  traverse(hit_pos, L, object_world_from_mdl, 
-                            object_mdl_from_world, Renderables, hit);
-                        //if(tv2_res.hit < 0 || tv2_res.dist*tv2_res.dist <= dl2)
-                        if(dl2 <= tv2_res.dist*tv2_res.dist)
-                        {
-                            L *= LLum;///dl2;
-                            //vec3 color_new = phong(view, L, hit_normal, albedo, spec_color, glossiness, metalness);
-                            vec3 color_new = blinn_phong(view, L, hit_normal, albedo, spec_color, glossiness, metalness);
-                            color += color_new*100.0f/dl2;
-                        }
-                    }
+    auto write_outputs = [&]() -> int
+    {
+        stage_timer output_timer("write_outputs");
+        std::vector<std::uint8_t> rgb8(backbuffer.size());
+        if(!outputs.empty())
+            tonemap_rgb8(tm, backbuffer.data(), cam.w, cam.h, rgb8.data(), pool);
+        for(const std::string &out : outputs)
+        {
+            std::wstring err = write_image(out, backbuffer, rgb8, cam.w, cam.h);
+            if(err != L"")
+            {
+                std::wcout << L"Error writing " << std::filesystem::path(out).wstring() << L": " << err << std::endl;
+                return -1;
+            }
+            std::wcout << L"Wrote " << std::filesystem::path(out).wstring() << std::endl;
+        }
+        if(!heatmap_base.empty())
+        {
+            std::wstring err = write_heatmap(heatmap_base, acc.cost, cam.w, cam.h, heatmap_kind);
+            if(err != L"")
+            {
+                std::wcout << L"Error writing heatmap " << std::filesystem::path(heatmap_base).wstring() << L": " << err << std::endl;
+                return -1;
+            }
+            std::wcout << L"Wrote " << std::filesystem::path(heatmap_base + ".pfm").wstring() << L" and .png" << std::endl;
+        }
+        return 0;
+    };
 
-                }
+    std::atomic<bool> &cancel = stop_requested;
 
-                
-            } while(false); //else {
-            /*
-            if (hit < 0) // Lets us break from the above if
+    // Resuming keeps saving to the file it came from unless told otherwise
+    if(checkpoint_path.empty())
+        checkpoint_path = resume_path;
+    checkpoint_schedule schedule;
+    checkpoint_schedule *checkpoint = nullptr;
+    int spp_start = 0;
+    if(!checkpoint_path.empty())
+    {
+        checkpoint_info &info = schedule.info;
+        info.w = cam.w;
+        info.h = cam.h;
+        info.camera = camera_index;
+        info.seed = seed;
+        info.sampler = sampler_kind;
+        info.adaptive = adaptive_threshold > 0.0f;
+        info.scene_hash = hash_file(path);
+        schedule.path = checkpoint_path;
+        schedule.interval = checkpoint_every;
+        checkpoint = &schedule;
+
+        // Preemptible nodes get a SIGTERM before they go away; stop at the end
+        // of the pass and save instead of losing everything since the last save.
+        std::signal(SIGINT, on_stop_signal);
+        std::signal(SIGTERM, on_stop_signal);
+    }
+    if(!resume_path.empty())
+    {
+        checkpoint_info saved;
+        std::wstring err = read_checkpoint(resume_path, schedule.info, saved, acc);
+        if(err != L"")
+        {
+            std::wcout << L"Can't resume from " << std::filesystem::path(resume_path).wstring() << L": " << err << std::endl;
+            return -1;
+        }
+        spp_start = saved.spp;
+        std::wcout << L"Resuming from " << std::filesystem::path(resume_path).wstring() << L" at "
+                   << spp_start << L" spp" << std::endl;
+    }
+    // Checkpoints don't keep costs, so a resumed heatmap only covers the samples since
+    if(!heatmap_base.empty())
+        acc.cost.assign(acc.sum.size(), 0.0f);
+
+#ifndef UTAH_HEADLESS
+    // SDL is only ever initialized here, so headless runs never touch it. The
+    // window opens right away and fills in one sample per pixel at a time while
+    // the render runs on its own thread; closing it stops the render.
+    if(!headless)
+    {
+        preview_buffer preview;
+        bool finished = false;
+        int status = 0;
+        std::thread worker([&]
+        {
+            ray_stats_scope render_rays;
+            stage_timer render_timer("render");
+            finished = render_progressive(ctx, tiles, pool, 1, spp_start, acc, backbuffer, &preview, checkpoint, cancel);
+            render_timer.stop();
+            if(finished)
             {
-                // background color (e.g., sky gradient)
-                //color = vec3{0.2f, 0.3f, 0.6f}; // tweak as desired
-                color = ambient;
-            }*/
-            //float cblnd = exp(-0.1*t_min);
-            //color = color*cblnd + (1.0-cblnd)*ambient;
-            //float cblnd = 0.5;
-            //if(0.9 < sin(10.0f*t_min))
-            //    color = color*cblnd + (1.0-cblnd)*ambient;
-
-            //color *= 10.0f;
-            color = max(color, vec3{0});
-            color = saturationClip(color);
-            color = pow(color, vec3{1.0/2.2});
-
-            backbuffer[(cam.w*iv + iu)*3 + 0] += color[0];
-            backbuffer[(cam.w*iv + iu)*3 + 1] += color[1];
-            backbuffer[(cam.w*iv + iu)*3 + 2] += color[2];
+                log_adaptive_samples(ctx, acc.samples());
+                log_time_budget(ctx, acc, run_start);
+                status = write_outputs();
+            }
+        });
+        tile_pool display_pool(std::min(threads, DISPLAY_THREADS));
+        sdl_display_progressive(preview, tm, cam.w, cam.h, display_pool, cancel);
+        worker.join();
+        if(!finished)
+        {
+            std::wcout << L"Window closed before the render finished, outputs not written" << std::endl;
+            if(checkpoint)
+                std::wcout << L"Rerun with --resume " << std::filesystem::path(checkpoint_path).wstring()
+                           << L" to finish it" << std::endl;
         }
+        write_reports();
+        return status;
     }
-
+#endif
+
+    // Checkpoints and the time budget are only checked between passes, so go a
+    // sample at a time when either is on
+    bool timed = deadline != std::chrono::steady_clock::time_point::max();
+    int pass_spp = (checkpoint || timed) ? 1 : spp_lim;
+    stage_timer render_timer("render");
+    bool finished = render_progressive(ctx, tiles, pool, pass_spp, spp_start, acc, backbuffer, nullptr, checkpoint, cancel);
+    render_timer.stop();
+    if(!finished)
+    {
+        std::wcout << L"Render stopped at " << schedule.info.spp << L" spp, rerun with --resume "
+                   << std::filesystem::path(checkpoint_path).wstring() << L" to finish it" << std::endl;
+        write_reports();
+        return 1;
     }
-
-    float flim = float(spp_lim);
-    for(auto &bb : backbuffer) bb /= flim;
-
-    sdl_display_bbuffer(backbuffer, cam.w, cam.h);
-    
-
-    return 0;
+    log_adaptive_samples(ctx, acc.samples());
+    log_time_budget(ctx, acc, run_start);
+    int status = write_outputs();
+    write_reports();
+    return status;
 }
 
 
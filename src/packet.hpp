@@ -0,0 +1,46 @@
+#ifndef PACKET_HPP
+#define PACKET_HPP
+
+#include <bit>
+#include <cstdint>
+#include "vec.hpp"
+#include "simd.hpp"
+
+// SIMD_WIDTH rays in SoA lanes, for batches that travel together: camera rays of
+// neighbouring pixels, shadow rays toward one directional light. Lane n is live if
+// bit n of active is set. Dead lanes are carried along but never reported.
+struct ray_packet
+{
+    float ox[SIMD_WIDTH] = {}, oy[SIMD_WIDTH] = {}, oz[SIMD_WIDTH] = {};
+    float dx[SIMD_WIDTH] = {}, dy[SIMD_WIDTH] = {}, dz[SIMD_WIDTH] = {};
+    float t_max[SIMD_WIDTH] = {};
+    float skip[SIMD_WIDTH] = {}; // Entity the lane ignores (the surface it starts on), as float
+    int prim[SIMD_WIDTH] = {};   // Closest primitive so far, -1 for none. Kernels decide what it indexes.
+    int active = 0;
+
+    // dir is normalized here, like traverse() does for single rays
+    void set(int lane, const vec<float,3> &org, const vec<float,3> &dir0, float t, int skip_entity)
+    {
+        vec<float,3> dir = normalize(dir0);
+        ox[lane] = org[0]; oy[lane] = org[1]; oz[lane] = org[2];
+        dx[lane] = dir[0]; dy[lane] = dir[1]; dz[lane] = dir[2];
+        t_max[lane] = t;
+        skip[lane] = float(skip_entity);
+        prim[lane] = -1;
+        active |= 1 << lane;
+    }
+
+    vec<float,3> org(int lane) const { return vec<float,3>{ox[lane], oy[lane], oz[lane]}; }
+    vec<float,3> dir(int lane) const { return vec<float,3>{dx[lane], dy[lane], dz[lane]}; }
+};
+
+// Lane bitmask (as used by ray_packet::active) to a simd_float mask
+inline simd_float lane_mask(int bits)
+{
+    float m[SIMD_WIDTH];
+    for(int n=0; n<SIMD_WIDTH; n++)
+        m[n] = std::bit_cast<float>(((bits >> n) & 1) ? 0xffffffffu : 0u);
+    return simd_float::load(m);
+}
+
+#endif // PACKET_HPP
@@ -0,0 +1,44 @@
+#ifndef PREVIEW_HPP
+#define PREVIEW_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Hands finished passes from the render threads to the display without either
+// side waiting on the other. The renderer copies into its own back buffer and
+// swaps it in; the display swaps the newest one out. Both swaps are O(1) under
+// the lock, so a slow texture upload never holds up the next pass.
+struct preview_buffer
+{
+    std::mutex lock;
+    std::vector<float> front;
+    std::uint64_t generation = 0; // Bumped on every publish
+    int spp = 0;                  // Samples per pixel in front
+
+    // Renderer side. back is only ever touched by the publishing thread.
+    void publish(const std::vector<float> &frame, int frame_spp)
+    {
+        back = frame;
+        std::lock_guard<std::mutex> guard(lock);
+        std::swap(back, front);
+        spp = frame_spp;
+        generation++;
+    }
+
+    // Display side. Swaps the newest frame into out if there is one it hasn't seen.
+    bool fetch(std::vector<float> &out, std::uint64_t &seen, int &out_spp)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(generation == seen) return false;
+        std::swap(out, front);
+        seen = generation;
+        out_spp = spp;
+        return true;
+    }
+
+private:
+    std::vector<float> back;
+};
+
+#endif // PREVIEW_HPP
@@ -0,0 +1,130 @@
+
+#include "render_scene.hpp"
+#include <iostream>
+#include <cmath>
+
+vec<float,3> blinn_phong_normalization(const vec<float,3> &spec_power)
+{
+    //return (spec_power+8.0f)/8.0f;
+    return (spec_power+2.0f)*(spec_power+4.0f)/(8.0f*3.141592f*(pow(2.0f, -spec_power/2.0f) + spec_power));
+}
+
+namespace
+{
+
+// World center and radius if W's linear part is r times a rotation, else radius 0.
+vec<float,4> similarity_sphere(const affine3x4 &W)
+{
+    // Columns of a scaled rotation are orthogonal with equal length r
+    vec<float,3> col[3];
+    for(int j=0; j<3; j++)
+        col[j] = vec<float,3>{W[j], W[4 + j], W[8 + j]};
+
+    float r2 = (dot(col[0],col[0]) + dot(col[1],col[1]) + dot(col[2],col[2]))/3.0f;
+    const float tol = 1e-5f*r2;
+    bool similar = r2 > 0.0f;
+    for(int i=0; i<3 && similar; i++)
+    for(int j=i; j<3 && similar; j++)
+        similar = std::abs(dot(col[i],col[j]) - ((i == j) ? r2 : 0.0f)) <= tol;
+
+    if(!similar) return vec<float,4>{0.0f};
+    return vec<float,4>{W[3], W[7], W[11], std::sqrt(r2)};
+}
+
+} // namespace
+
+render_scene bake_render_scene(const renderables &Renderables,
+    const std::vector<affine3x4> &object_world_from_mdl)
+{
+    typedef vec<float,3> vec3;
+    render_scene scene;
+
+    for(int n=0; n<Renderables.materials.len; n++)
+    {
+        const material &mat = Renderables.materials.items[n];
+        render_material m;
+        m.albedo = pow(vec3(mat.albedo,3), vec3{2.2});
+        m.spec_color = pow(vec3(mat.spec_color,3), vec3{2.2});
+        m.spec_power = vec3(mat.glossiness,3);
+        m.metalness = vec3(mat.glossiness_value);
+        m.spec_norm = blinn_phong_normalization(m.spec_power);
+        m.ambient_reflect = lerp(m.albedo, m.spec_color, m.metalness);
+        scene.materials.push_back(m);
+        scene.names.materials.push_back(mat.name);
+    }
+
+    for(int n=0; n<Renderables.objects.len; n++)
+    {
+        const object &obj = Renderables.objects.items[n];
+        render_object o;
+        o.entity = obj.entity;
+        o.material = (0 <= obj.mid && obj.mid < int(scene.materials.size())) ? obj.mid : -1;
+        o.type = PRIM_NONE;
+        vec<float,4> world_sphere{0.0f};
+        if(obj.type == L"sphere")
+        {
+            world_sphere = similarity_sphere(object_world_from_mdl[n]);
+            o.type = (world_sphere[3] > 0.0f) ? PRIM_SPHERE : PRIM_ELLIPSOID;
+        }
+        scene.objects.push_back(o);
+        scene.world_spheres.push_back(world_sphere);
+        scene.names.objects.push_back(obj.name);
+        scene.names.object_types.push_back(obj.type);
+    }
+
+    // The first ambient light sets the ambient color, falling back to a sky blue
+    vec3 ambient = vec3{0.2f, 0.3f, 0.6f};
+    int ambient_lights = 0;
+    for(int n=0; n<Renderables.lights.len; n++)
+    {
+        if(Renderables.lights[n].type != L"ambient") continue;
+        if(ambient_lights == 0)
+            ambient = vec3(Renderables.lights[n].intensity, 3);
+        ambient_lights++;
+    }
+    scene.ambient = pow(ambient, vec3{2.2});
+    scene.ambient_light = scene.ambient*float(ambient_lights);
+
+    for(int n=0; n<Renderables.lights.len; n++)
+    {
+        const light &Light = Renderables.lights[n];
+        vec3 radiance = pow(vec3(Light.intensity,3), vec3{2.2});
+        if(Light.type == L"direct")
+        {
+            scene.direct_lights.push_back(direct_light{-normalize(vec3(Light.direction, 3)), radiance});
+            scene.names.direct_lights.push_back(Light.name);
+        }
+        else if(Light.type == L"point")
+        {
+            scene.point_lights.push_back(point_light{vec3(Light.position, 3), radiance});
+            scene.names.point_lights.push_back(Light.name);
+        }
+    }
+
+    return scene;
+}
+
+void dump_render_scene(const render_scene &scene, int max_items)
+{
+    int world_spheres = 0;
+    for(const render_object &o : scene.objects)
+        world_spheres += (o.type == PRIM_SPHERE);
+
+    std::wcout << L"render_scene: " << scene.objects.size() << L" objects ("
+               << world_spheres << L" world-space spheres), "
+               << scene.materials.size() << L" materials, "
+               << scene.direct_lights.size() << L" direct lights, "
+               << scene.point_lights.size() << L" point lights" << std::endl;
+
+    for(std::size_t n=0; n<scene.objects.size() && int(n)<max_items; n++)
+    {
+        const render_object &o = scene.objects[n];
+        std::wcout << L"  object " << n << L" '" << scene.names.objects[n] << L"' ("
+                   << scene.names.object_types[n] << L") entity " << o.entity << L" -> material ";
+        if(o.material < 0)
+            std::wcout << L"none";
+        else
+            std::wcout << o.material << L" '" << scene.names.materials[std::size_t(o.material)] << L"'";
+        std::wcout << std::endl;
+    }
+}
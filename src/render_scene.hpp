@@ -0,0 +1,89 @@
+#ifndef RENDER_SCENE_HPP
+#define RENDER_SCENE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vec.hpp"
+#include "affine.hpp"
+#include "xml_compiler.hpp"
+
+// Render-only copy of the scene, baked once after init_renderables. The hot path
+// reads only this: enums instead of type strings, dense material indices instead
+// of entity lookups, colors already in linear space, and lights split by type.
+// Names live in a cold side table that only debugging output touches.
+
+enum prim_type : std::uint8_t
+{
+    PRIM_NONE = 0,  // Anything the tracer can't intersect yet
+    PRIM_SPHERE,    // Unit sphere under a similarity transform: a world center and radius
+    PRIM_ELLIPSOID  // Unit sphere under any other affine, intersected in model space
+};
+
+inline bool traceable(prim_type type) { return type != PRIM_NONE; }
+
+// Indexed like renderables::objects, so object indices carry over unchanged.
+struct render_object
+{
+    int entity;
+    int material; // Index into render_scene::materials, -1 if unresolved
+    prim_type type;
+};
+
+struct render_material
+{
+    vec<float,3> albedo;      // Linear
+    vec<float,3> spec_color;  // Linear
+    vec<float,3> spec_power;  // Blinn-Phong exponent per channel
+    vec<float,3> metalness;
+    vec<float,3> spec_norm;   // Blinn-Phong energy normalization for spec_power
+    vec<float,3> ambient_reflect; // lerp(albedo, spec_color, metalness)
+};
+
+struct direct_light
+{
+    vec<float,3> L;        // Unit vector toward the light
+    vec<float,3> radiance; // Linear
+};
+
+struct point_light
+{
+    vec<float,3> position;
+    vec<float,3> radiance; // Linear
+};
+
+// Cold side table, same indexing as the hot arrays
+struct render_scene_names
+{
+    std::vector<std::wstring> objects;
+    std::vector<std::wstring> object_types;
+    std::vector<std::wstring> materials;
+    std::vector<std::wstring> direct_lights;
+    std::vector<std::wstring> point_lights;
+};
+
+struct render_scene
+{
+    std::vector<render_object> objects;
+    std::vector<vec<float,4>> world_spheres; // Center and radius per object, set for PRIM_SPHERE
+    std::vector<render_material> materials;
+    std::vector<direct_light> direct_lights;
+    std::vector<point_light> point_lights;
+
+    vec<float,3> ambient{0.0f}; // Linear background and ambient light color
+    vec<float,3> ambient_light{0.0f}; // ambient summed over every ambient light in the scene
+
+    render_scene_names names;
+};
+
+vec<float,3> blinn_phong_normalization(const vec<float,3> &spec_power);
+
+// Sphere objects whose world_from_mdl is uniform scale times a rotation come out as
+// PRIM_SPHERE with a world center and radius (rotation doesn't change a sphere's
+// shape). Everything else that says "sphere" is a PRIM_ELLIPSOID.
+render_scene bake_render_scene(const renderables &Renderables,
+    const std::vector<affine3x4> &object_world_from_mdl);
+
+void dump_render_scene(const render_scene &scene, int max_items);
+
+#endif // RENDER_SCENE_HPP
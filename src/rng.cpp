@@ -0,0 +1,9 @@
+
+#include "rng.hpp"
+
+void rng_fill(float *out, int count,
+    std::uint32_t seed, std::uint32_t pixel, std::uint32_t sample, std::uint32_t dim0)
+{
+    for(int n=0; n<count; n++)
+        out[n] = rng_float(seed, pixel, sample, dim0 + std::uint32_t(n));
+}
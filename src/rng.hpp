@@ -0,0 +1,51 @@
+#ifndef RNG_HPP
+#define RNG_HPP
+
+#include <bit>
+#include <cstdint>
+
+// Counter-based random numbers. There is no mutable generator state: every value is
+// a pure hash of (seed, pixel, sample, dimension), so any thread can draw any sample
+// in any order and get the same bits. That makes renders reproducible regardless of
+// thread count or tile scheduling.
+//
+// The hash is pcg4d from Jarzynski & Olano, "Hash Functions for GPU Rendering" (JCGT 2020).
+// It only uses 32-bit mul/add/xor/shift.
+
+inline void pcg4d(std::uint32_t &x, std::uint32_t &y, std::uint32_t &z, std::uint32_t &w)
+{
+    x = x*1664525u + 1013904223u;
+    y = y*1664525u + 1013904223u;
+    z = z*1664525u + 1013904223u;
+    w = w*1664525u + 1013904223u;
+
+    x += y*w; y += z*x; z += x*y; w += y*z;
+
+    x ^= x >> 16; y ^= y >> 16; z ^= z >> 16; w ^= w >> 16;
+
+    x += y*w; y += z*x; z += x*y; w += y*z;
+}
+
+inline std::uint32_t rng_u32(std::uint32_t seed, std::uint32_t pixel, std::uint32_t sample, std::uint32_t dim)
+{
+    std::uint32_t x = pixel, y = sample, z = dim, w = seed;
+    pcg4d(x, y, z, w);
+    return x;
+}
+
+// Same bit trick as xorshiftflt: top 23 bits into the mantissa of [1,2), minus 1.
+inline float rng_u32_to_float(std::uint32_t u)
+{
+    return std::bit_cast<float>(0x3f800000u | (u >> 9)) - 1.0f;
+}
+
+inline float rng_float(std::uint32_t seed, std::uint32_t pixel, std::uint32_t sample, std::uint32_t dim)
+{
+    return rng_u32_to_float(rng_u32(seed, pixel, sample, dim));
+}
+
+// out[n] = rng_float(seed, pixel, sample, dim0 + n) for n in [0,count).
+void rng_fill(float *out, int count,
+    std::uint32_t seed, std::uint32_t pixel, std::uint32_t sample, std::uint32_t dim0);
+
+#endif // RNG_HPP
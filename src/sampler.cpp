@@ -0,0 +1,228 @@
+
+#include "sampler.hpp"
+#include "rng.hpp"
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+
+// Tags for the hashes that seed each pair's scrambles, so they never line up
+// with each other or with the rng_* dimensions a render draws directly.
+const std::uint32_t SCRAMBLE_INDEX = 0x5EED0000u;
+const std::uint32_t SCRAMBLE_X     = 0x5EED0001u;
+const std::uint32_t SCRAMBLE_Y     = 0x5EED0002u;
+
+std::uint32_t reverse_bits(std::uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Laine-Karras style hash that only lets bits affect higher bits. Applied to
+// bit-reversed values it is a random Owen scramble, from Burley,
+// "Practical Hash-based Owen Scrambling" (JCGT 2020).
+std::uint32_t laine_karras_permutation(std::uint32_t x, std::uint32_t seed)
+{
+    x += seed;
+    x ^= x*0x6c50b47cu;
+    x ^= x*0xb82f1e52u;
+    x ^= x*0xc7afe638u;
+    x ^= x*0x8d22f6e6u;
+    return x;
+}
+
+std::uint32_t nested_uniform_scramble(std::uint32_t x, std::uint32_t seed)
+{
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+// Second Sobol dimension; the first is just reverse_bits(i).
+std::uint32_t sobol_dim1(std::uint32_t i)
+{
+    std::uint32_t r = 0;
+    for(std::uint32_t v = 1u << 31; i != 0; i >>= 1, v ^= v >> 1)
+        if(i & 1) r ^= v;
+    return r;
+}
+
+float radical_inverse(std::uint32_t i, std::uint32_t base)
+{
+    double inv = 1.0/double(base);
+    double f = inv;
+    double r = 0.0;
+    for(; i != 0; i /= base, f *= inv)
+        r += double(i % base)*f;
+    return float(r);
+}
+
+// Largest float below 1, so wrapped sums never land on 1 exactly
+const float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+float wrap01(double x)
+{
+    return std::min(float(x - std::floor(x)), ONE_MINUS_EPSILON);
+}
+
+// Ulichney's void-and-cluster on a torus: every pixel gets a rank such that the
+// pixels below any threshold are as evenly spread as possible.
+std::vector<float> void_and_cluster()
+{
+    const int S = BLUE_NOISE_SIZE;
+    const int N = S*S;
+    const float sigma = 1.5f;
+
+    // Gaussian of the toroidal offset, indexed by ((dy & S-1)*S + (dx & S-1))
+    std::vector<float> kernel(std::size_t(N), 0.0f);
+    for(int dy=0; dy<S; dy++)
+    for(int dx=0; dx<S; dx++)
+    {
+        float x = float(std::min(dx, S - dx));
+        float y = float(std::min(dy, S - dy));
+        kernel[std::size_t(dy*S + dx)] = std::exp(-(x*x + y*y)/(2.0f*sigma*sigma));
+    }
+
+    std::vector<std::uint8_t> on(std::size_t(N), 0);
+    std::vector<float> energy(std::size_t(N), 0.0f);
+    auto toggle = [&](int p, bool set)
+    {
+        on[std::size_t(p)] = set;
+        float sign = set ? 1.0f : -1.0f;
+        int px = p % S, py = p / S;
+        for(int qy=0; qy<S; qy++)
+        for(int qx=0; qx<S; qx++)
+            energy[std::size_t(qy*S + qx)] += sign*kernel[std::size_t(((qy - py) & (S - 1))*S + ((qx - px) & (S - 1)))];
+    };
+    auto tightest_cluster = [&]()
+    {
+        int best = -1;
+        for(int p=0; p<N; p++)
+            if(on[std::size_t(p)] && (best < 0 || energy[std::size_t(p)] > energy[std::size_t(best)]))
+                best = p;
+        return best;
+    };
+    auto largest_void = [&]()
+    {
+        int best = -1;
+        for(int p=0; p<N; p++)
+            if(!on[std::size_t(p)] && (best < 0 || energy[std::size_t(p)] < energy[std::size_t(best)]))
+                best = p;
+        return best;
+    };
+
+    // Random initial pattern with a tenth of the pixels set, then swap the
+    // tightest cluster into the largest void until that stops moving anything.
+    int ones = 0;
+    for(std::uint32_t k=0; ones < N/10; k++)
+    {
+        int p = int(rng_u32(1, k, 0, 0) % std::uint32_t(N));
+        if(on[std::size_t(p)]) continue;
+        toggle(p, true);
+        ones++;
+    }
+    for(int iter=0; iter<N; iter++)
+    {
+        int c = tightest_cluster();
+        toggle(c, false);
+        int v = largest_void();
+        toggle(v, true);
+        if(v == c) break;
+    }
+
+    std::vector<int> rank(std::size_t(N), 0);
+    std::vector<std::uint8_t> proto_on = on;
+    std::vector<float> proto_energy = energy;
+
+    // Ranks below the prototype: peel off the tightest clusters
+    for(int r=ones-1; r>=0; r--)
+    {
+        int c = tightest_cluster();
+        toggle(c, false);
+        rank[std::size_t(c)] = r;
+    }
+
+    // Ranks above it: fill the largest voids until the tile is full
+    on = proto_on;
+    energy = proto_energy;
+    for(int r=ones; r<N; r++)
+    {
+        int v = largest_void();
+        toggle(v, true);
+        rank[std::size_t(v)] = r;
+    }
+
+    std::vector<float> tile(std::size_t(N), 0.0f);
+    for(int p=0; p<N; p++)
+        tile[std::size_t(p)] = (float(rank[std::size_t(p)]) + 0.5f)/float(N);
+    return tile;
+}
+
+} // namespace
+
+void sampler::get2d(int x, int y, std::uint32_t sample, std::uint32_t pair, float out[2]) const
+{
+    std::uint32_t pixel = std::uint32_t(width*y + x);
+    switch(type)
+    {
+    case SAMPLER_RANDOM:
+        rng_fill(out, 2, seed, pixel, sample, 2*pair);
+        return;
+
+    case SAMPLER_SOBOL:
+    {
+        // Shuffle the sample order per pixel, then scramble each dimension
+        std::uint32_t i = nested_uniform_scramble(sample, rng_u32(seed, pixel, pair, SCRAMBLE_INDEX));
+        out[0] = rng_u32_to_float(nested_uniform_scramble(reverse_bits(i), rng_u32(seed, pixel, pair, SCRAMBLE_X)));
+        out[1] = rng_u32_to_float(nested_uniform_scramble(sobol_dim1(i), rng_u32(seed, pixel, pair, SCRAMBLE_Y)));
+        return;
+    }
+
+    case SAMPLER_HALTON:
+    {
+        static const std::uint32_t primes[16] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+        std::uint32_t b0 = primes[(2*pair) % 16];
+        std::uint32_t b1 = primes[(2*pair + 1) % 16];
+        out[0] = wrap01(double(radical_inverse(sample, b0)) + double(rng_float(seed, pixel, pair, SCRAMBLE_X)));
+        out[1] = wrap01(double(radical_inverse(sample, b1)) + double(rng_float(seed, pixel, pair, SCRAMBLE_Y)));
+        return;
+    }
+
+    case SAMPLER_BLUE_NOISE:
+    {
+        // Each dimension reads the tile at its own toroidal offset, then walks
+        // the R2 sequence so successive samples stay stratified per pixel.
+        const int mask = BLUE_NOISE_SIZE - 1;
+        std::uint32_t ox = rng_u32(seed, 0, pair, SCRAMBLE_X);
+        std::uint32_t oy = rng_u32(seed, 0, pair, SCRAMBLE_Y);
+        int x0 = (x + int(ox & 0xFFFFu)) & mask, y0 = (y + int(ox >> 16)) & mask;
+        int x1 = (x + int(oy & 0xFFFFu)) & mask, y1 = (y + int(oy >> 16)) & mask;
+        out[0] = wrap01(double(blue_noise[std::size_t(y0*BLUE_NOISE_SIZE + x0)]) + double(sample)*0.7548776662466927);
+        out[1] = wrap01(double(blue_noise[std::size_t(y1*BLUE_NOISE_SIZE + x1)]) + double(sample)*0.5698402909980532);
+        return;
+    }
+    }
+}
+
+sampler make_sampler(sampler_type type, std::uint32_t seed, int width)
+{
+    sampler s;
+    s.type = type;
+    s.seed = seed;
+    s.width = width;
+    if(type == SAMPLER_BLUE_NOISE)
+        s.blue_noise = void_and_cluster();
+    return s;
+}
+
+bool parse_sampler_type(const std::string &name, sampler_type &type)
+{
+    if(name == "random") type = SAMPLER_RANDOM;
+    else if(name == "sobol") type = SAMPLER_SOBOL;
+    else if(name == "halton") type = SAMPLER_HALTON;
+    else if(name == "bluenoise") type = SAMPLER_BLUE_NOISE;
+    else return false;
+    return true;
+}
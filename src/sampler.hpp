@@ -0,0 +1,42 @@
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sample generators for anything that integrates over a domain: pixel jitter
+// today, light and BSDF sampling as they show up. Like rng.hpp, every point is
+// a pure function of (seed, pixel, sample, dimension), so any thread can draw
+// any sample in any order.
+//
+// Dimensions are handed out in pairs. Each pair is its own well-stratified 2D
+// sequence, decorrelated from the other pairs and from neighbouring pixels.
+enum sampler_type : std::uint8_t
+{
+    SAMPLER_RANDOM,     // Independent pcg4d draws, plain Monte Carlo
+    SAMPLER_SOBOL,      // First two Sobol dimensions, Owen-scrambled per pixel and pair
+    SAMPLER_HALTON,     // Halton in consecutive prime bases, rotated per pixel
+    SAMPLER_BLUE_NOISE, // Tiled blue-noise offsets advanced by the R2 sequence per sample
+};
+
+const int BLUE_NOISE_SIZE = 64; // Tile side, a power of two
+
+struct sampler
+{
+    sampler_type type = SAMPLER_RANDOM;
+    std::uint32_t seed = 0;
+    int width = 0; // Image width, pixel index is y*width + x
+    std::vector<float> blue_noise; // BLUE_NOISE_SIZE^2 ranks in [0,1), only for SAMPLER_BLUE_NOISE
+
+    // Point in [0,1)^2 for dimension pair `pair` of sample `sample` at pixel (x,y)
+    void get2d(int x, int y, std::uint32_t sample, std::uint32_t pair, float out[2]) const;
+};
+
+// Builds the blue-noise tile (void and cluster, a few ms) when it is asked for.
+sampler make_sampler(sampler_type type, std::uint32_t seed, int width);
+
+// "random", "sobol", "halton" or "bluenoise"; false if name is none of those.
+bool parse_sampler_type(const std::string &name, sampler_type &type);
+
+#endif // SAMPLER_HPP
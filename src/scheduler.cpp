@@ -0,0 +1,200 @@
+
+#include "scheduler.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+unsigned int morton2(unsigned int x, unsigned int y)
+{
+    // Spread the low 16 bits of each coordinate out to the even bits.
+    auto part1by1 = [](unsigned int v)
+    {
+        v &= 0x0000ffffu;
+        v = (v | (v << 8)) & 0x00ff00ffu;
+        v = (v | (v << 4)) & 0x0f0f0f0fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    };
+    return part1by1(x) | (part1by1(y) << 1);
+}
+
+std::vector<tile> make_tiles(int w, int h, int tile_size)
+{
+    std::vector<tile> tiles;
+    if(w <= 0 || h <= 0) return tiles;
+    if(tile_size <= 0) tile_size = std::max(w, h);
+
+    int tw = (w + tile_size - 1)/tile_size;
+    int th = (h + tile_size - 1)/tile_size;
+    tiles.reserve(std::size_t(tw*th));
+
+    for(int ty=0; ty<th; ty++)
+        for(int tx=0; tx<tw; tx++)
+        {
+            tile t;
+            t.x0 = tx*tile_size;
+            t.y0 = ty*tile_size;
+            t.x1 = std::min(w, t.x0 + tile_size);
+            t.y1 = std::min(h, t.y0 + tile_size);
+            t.id = int(morton2(tx, ty)); // Temporary sort key, renumbered below
+            tiles.push_back(t);
+        }
+
+    std::sort(tiles.begin(), tiles.end(), [](const tile& a, const tile& b){ return a.id < b.id; });
+    for(std::size_t n=0; n<tiles.size(); n++)
+        tiles[n].id = int(n);
+    return tiles;
+}
+
+int default_thread_count()
+{
+    unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : int(n);
+}
+
+// One worker's share of the tiles. Padded to a cache line so neighbouring
+// queues' locks don't false-share.
+struct alignas(64) tile_queue
+{
+    std::mutex lock;
+    std::deque<int> items;
+
+    bool pop_front(int &out)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(items.empty()) return false;
+        out = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    bool steal_back(int &out)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(items.empty()) return false;
+        out = items.back();
+        items.pop_back();
+        return true;
+    }
+};
+
+struct tile_pool_state
+{
+    std::vector<std::thread> workers;
+    std::unique_ptr<tile_queue[]> queues;
+    std::mutex run_lock; // Held by the caller whose tiles are in the queues
+
+    // Hands a tile set to the waiting workers
+    std::mutex lock;
+    std::condition_variable wake, done;
+    const std::vector<tile> *tiles = nullptr;
+    const std::function<void(const tile&, int)> *fn = nullptr;
+    std::uint64_t generation = 0; // Tile sets handed out so far
+    int busy = 0;                 // Workers still on the current set
+    bool quit = false;
+
+    // No work is ever added to a set once it starts, so once every queue reads
+    // empty a worker can safely retire.
+    void work(int tid, int threads)
+    {
+        int idx = -1;
+        while(true)
+        {
+            if(queues[tid].pop_front(idx))
+            {
+                (*fn)((*tiles)[idx], tid);
+                continue;
+            }
+
+            bool stole = false;
+            for(int k=1; k<threads && !stole; k++)
+                stole = queues[(tid + k) % threads].steal_back(idx);
+            if(!stole) break;
+            (*fn)((*tiles)[idx], tid);
+        }
+    }
+};
+
+tile_pool::tile_pool(int thread_count)
+    : threads(thread_count <= 0 ? default_thread_count() : thread_count),
+      state(std::make_unique<tile_pool_state>())
+{
+    state->queues = std::make_unique<tile_queue[]>(std::size_t(threads));
+    state->workers.reserve(std::size_t(threads - 1));
+    for(int tid=1; tid<threads; tid++)
+        state->workers.emplace_back([this, tid]
+        {
+            TRACE_THREAD_NAME("worker", tid);
+            ray_stats_scope counted;
+            tile_pool_state &s = *state;
+            std::uint64_t seen = 0;
+            while(true)
+            {
+                {
+                    std::unique_lock<std::mutex> guard(s.lock);
+                    s.wake.wait(guard, [&]{ return s.quit || s.generation != seen; });
+                    if(s.quit) return;
+                    seen = s.generation;
+                }
+                s.work(tid, threads);
+                std::lock_guard<std::mutex> guard(s.lock);
+                if(--s.busy == 0)
+                    s.done.notify_one();
+            }
+        });
+}
+
+tile_pool::~tile_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->quit = true;
+    }
+    state->wake.notify_all();
+    for(std::thread &t : state->workers)
+        t.join();
+}
+
+void tile_pool::run(const std::vector<tile>& tiles, const std::function<void(const tile&, int)>& fn)
+{
+    if(tiles.empty()) return;
+
+    if(threads == 1 || tiles.size() == 1)
+    {
+        for(const tile &t : tiles)
+            fn(t, 0);
+        return;
+    }
+
+    std::lock_guard<std::mutex> owner(state->run_lock);
+
+    // Seed each queue with a contiguous run of the curve
+    for(int q=0; q<threads; q++)
+    {
+        std::size_t lo = tiles.size()*std::size_t(q    )/std::size_t(threads);
+        std::size_t hi = tiles.size()*std::size_t(q + 1)/std::size_t(threads);
+        for(std::size_t n=lo; n<hi; n++)
+            state->queues[q].items.push_back(int(n));
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->tiles = &tiles;
+        state->fn = &fn;
+        state->busy = threads - 1;
+        state->generation++;
+    }
+    state->wake.notify_all();
+    state->work(0, threads); // The calling thread works too
+
+    std::unique_lock<std::mutex> guard(state->lock);
+    state->done.wait(guard, [&]{ return state->busy == 0; });
+    state->tiles = nullptr;
+    state->fn = nullptr;
+}
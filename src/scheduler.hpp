@@ -0,0 +1,60 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <vector>
+#include <functional>
+#include <memory>
+
+// A screen-space rectangle of pixels [x0,x1) x [y0,y1).
+struct tile
+{
+    int id;
+    int x0, y0;
+    int x1, y1;
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+    int area() const { return width()*height(); }
+};
+
+// Interleave the low 16 bits of x and y: ...y1x1y0x0
+unsigned int morton2(unsigned int x, unsigned int y);
+
+// Split a w*h frame into tile_size squares (edge tiles are clipped), ordered along
+// a Morton curve so neighbouring tiles in the list are neighbours on screen.
+std::vector<tile> make_tiles(int w, int h, int tile_size);
+
+// hardware_concurrency, but never 0.
+int default_thread_count();
+
+struct tile_pool_state;
+
+// A pool of `threads` workers created once per run: the caller of run() is
+// worker 0 and threads-1 more wait in the pool between calls, so a pass costs
+// a wakeup rather than spawning threads. Each worker keeps the same id for the
+// life of the pool.
+struct tile_pool
+{
+    explicit tile_pool(int threads); // <= 0 means default_thread_count()
+    tile_pool(const tile_pool&) = delete;
+    tile_pool& operator=(const tile_pool&) = delete;
+    ~tile_pool();
+
+    int size() const { return threads; }
+
+    // Run fn(tile, thread_id) once for every tile, returning when all are done.
+    // Each worker owns a deque seeded with a contiguous run of the Morton-ordered
+    // tiles. Owners pop from the front (keeps walking the curve), idle workers
+    // steal from the back of someone else's deque (the far end of their run), so
+    // stealing rarely fights the owner for the same region of the frame.
+    // Tiles never overlap, so fn can write its pixels without synchronization.
+    // The pool takes one tile set at a time; a second caller waits its turn.
+    // Don't call run() from inside fn.
+    void run(const std::vector<tile>& tiles, const std::function<void(const tile&, int)>& fn);
+
+private:
+    int threads;
+    std::unique_ptr<tile_pool_state> state;
+};
+
+#endif // SCHEDULER_HPP
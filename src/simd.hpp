@@ -0,0 +1,190 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <bit>
+#include <cstdint>
+#include <cmath>
+
+// Thin wrapper over the widest float vector the compiler is allowed to emit:
+// 8 lanes with AVX, 4 with SSE2, 1 (plain float) otherwise. Kernels are written
+// once against simd_float and the build flags (ARCHFLAGS) pick the width.
+// Masks are simd_floats with every bit of a lane set or clear, as the hardware does it.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX__)
+
+const int SIMD_WIDTH = 8;
+
+struct simd_float
+{
+    __m256 v;
+
+    static simd_float load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    static simd_float set1(float x) { return {_mm256_set1_ps(x)}; }
+    static simd_float iota() { return {_mm256_setr_ps(0,1,2,3,4,5,6,7)}; }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    friend simd_float operator+(simd_float a, simd_float b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend simd_float operator-(simd_float a, simd_float b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend simd_float operator*(simd_float a, simd_float b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend simd_float operator/(simd_float a, simd_float b) { return {_mm256_div_ps(a.v, b.v)}; }
+    friend simd_float operator-(simd_float a) { return {_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f))}; }
+
+    friend simd_float operator<(simd_float a, simd_float b)  { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+    friend simd_float operator<=(simd_float a, simd_float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+    friend simd_float operator>(simd_float a, simd_float b)  { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+    friend simd_float operator>=(simd_float a, simd_float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+    friend simd_float operator==(simd_float a, simd_float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ)}; }
+    friend simd_float operator!=(simd_float a, simd_float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ)}; }
+    friend simd_float operator&(simd_float a, simd_float b) { return {_mm256_and_ps(a.v, b.v)}; }
+    friend simd_float operator|(simd_float a, simd_float b) { return {_mm256_or_ps(a.v, b.v)}; }
+};
+
+inline simd_float sqrt(simd_float a) { return {_mm256_sqrt_ps(a.v)}; }
+inline simd_float min(simd_float a, simd_float b) { return {_mm256_min_ps(a.v, b.v)}; }
+inline simd_float max(simd_float a, simd_float b) { return {_mm256_max_ps(a.v, b.v)}; }
+inline simd_float andnot(simd_float mask, simd_float a) { return {_mm256_andnot_ps(mask.v, a.v)}; }
+inline simd_float select(simd_float mask, simd_float a, simd_float b) { return {_mm256_blendv_ps(b.v, a.v, mask.v)}; }
+inline int movemask(simd_float mask) { return _mm256_movemask_ps(mask.v); }
+
+inline float hmin(simd_float a)
+{
+    __m128 m = _mm_min_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+    m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+
+// SIMD_WIDTH interleaved xyz triples (24 floats) at p, one vector per component.
+// Pairs of 128-bit loads put pixels n and n+4 in the same lane of each half,
+// then three rounds of shuffles sort the components out.
+inline void load_deinterleave3(const float *p, simd_float &x, simd_float &y, simd_float &z)
+{
+    __m256 m03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 0)), _mm_loadu_ps(p + 12), 1);
+    __m256 m14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1);
+    __m256 m25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1);
+    __m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2,1,3,2));
+    __m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1,0,2,1));
+    x.v = _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2,0,3,0));
+    y.v = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3,1,2,0));
+    z.v = _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3,0,3,1));
+}
+
+#elif defined(__SSE2__)
+
+const int SIMD_WIDTH = 4;
+
+struct simd_float
+{
+    __m128 v;
+
+    static simd_float load(const float *p) { return {_mm_loadu_ps(p)}; }
+    static simd_float set1(float x) { return {_mm_set1_ps(x)}; }
+    static simd_float iota() { return {_mm_setr_ps(0,1,2,3)}; }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend simd_float operator+(simd_float a, simd_float b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend simd_float operator-(simd_float a, simd_float b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend simd_float operator*(simd_float a, simd_float b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend simd_float operator/(simd_float a, simd_float b) { return {_mm_div_ps(a.v, b.v)}; }
+    friend simd_float operator-(simd_float a) { return {_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))}; }
+
+    friend simd_float operator<(simd_float a, simd_float b)  { return {_mm_cmplt_ps(a.v, b.v)}; }
+    friend simd_float operator<=(simd_float a, simd_float b) { return {_mm_cmple_ps(a.v, b.v)}; }
+    friend simd_float operator>(simd_float a, simd_float b)  { return {_mm_cmpgt_ps(a.v, b.v)}; }
+    friend simd_float operator>=(simd_float a, simd_float b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+    friend simd_float operator==(simd_float a, simd_float b) { return {_mm_cmpeq_ps(a.v, b.v)}; }
+    friend simd_float operator!=(simd_float a, simd_float b) { return {_mm_cmpneq_ps(a.v, b.v)}; }
+    friend simd_float operator&(simd_float a, simd_float b) { return {_mm_and_ps(a.v, b.v)}; }
+    friend simd_float operator|(simd_float a, simd_float b) { return {_mm_or_ps(a.v, b.v)}; }
+};
+
+inline simd_float sqrt(simd_float a) { return {_mm_sqrt_ps(a.v)}; }
+inline simd_float min(simd_float a, simd_float b) { return {_mm_min_ps(a.v, b.v)}; }
+inline simd_float max(simd_float a, simd_float b) { return {_mm_max_ps(a.v, b.v)}; }
+inline simd_float andnot(simd_float mask, simd_float a) { return {_mm_andnot_ps(mask.v, a.v)}; }
+inline simd_float select(simd_float mask, simd_float a, simd_float b)
+{
+    return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+}
+inline int movemask(simd_float mask) { return _mm_movemask_ps(mask.v); }
+
+inline float hmin(simd_float a)
+{
+    __m128 m = _mm_min_ps(a.v, _mm_movehl_ps(a.v, a.v));
+    m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+
+// SIMD_WIDTH interleaved xyz triples (12 floats) at p, one vector per component
+inline void load_deinterleave3(const float *p, simd_float &x, simd_float &y, simd_float &z)
+{
+    __m128 a = _mm_loadu_ps(p + 0); // x0 y0 z0 x1
+    __m128 b = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+    __m128 c = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+    __m128 bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0,1,0,2));                       // x2 y1 x3 z2
+    x.v = _mm_shuffle_ps(a, bc, _MM_SHUFFLE(2,0,3,0));                              // x0 x1 x2 x3
+    y.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)),
+                         _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0)); // y0 y1 y2 y3
+    z.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)),
+                         _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0)); // z0 z1 z2 z3
+}
+
+#else
+
+const int SIMD_WIDTH = 1;
+
+struct simd_float
+{
+    float v;
+
+    static simd_float load(const float *p) { return {*p}; }
+    static simd_float set1(float x) { return {x}; }
+    static simd_float iota() { return {0.0f}; }
+    void store(float *p) const { *p = v; }
+
+    static simd_float mask(bool b) { return {std::bit_cast<float>(b ? 0xffffffffu : 0u)}; }
+    static std::uint32_t bits(simd_float a) { return std::bit_cast<std::uint32_t>(a.v); }
+
+    friend simd_float operator+(simd_float a, simd_float b) { return {a.v + b.v}; }
+    friend simd_float operator-(simd_float a, simd_float b) { return {a.v - b.v}; }
+    friend simd_float operator*(simd_float a, simd_float b) { return {a.v * b.v}; }
+    friend simd_float operator/(simd_float a, simd_float b) { return {a.v / b.v}; }
+    friend simd_float operator-(simd_float a) { return {-a.v}; }
+
+    friend simd_float operator<(simd_float a, simd_float b)  { return mask(a.v <  b.v); }
+    friend simd_float operator<=(simd_float a, simd_float b) { return mask(a.v <= b.v); }
+    friend simd_float operator>(simd_float a, simd_float b)  { return mask(a.v >  b.v); }
+    friend simd_float operator>=(simd_float a, simd_float b) { return mask(a.v >= b.v); }
+    friend simd_float operator==(simd_float a, simd_float b) { return mask(a.v == b.v); }
+    friend simd_float operator!=(simd_float a, simd_float b) { return mask(a.v != b.v); }
+    friend simd_float operator&(simd_float a, simd_float b) { return {std::bit_cast<float>(bits(a) & bits(b))}; }
+    friend simd_float operator|(simd_float a, simd_float b) { return {std::bit_cast<float>(bits(a) | bits(b))}; }
+};
+
+inline simd_float sqrt(simd_float a) { return {std::sqrt(a.v)}; }
+// Same operand order as minps/maxps, so NaN handling matches the vector paths
+inline simd_float min(simd_float a, simd_float b) { return {a.v < b.v ? a.v : b.v}; }
+inline simd_float max(simd_float a, simd_float b) { return {a.v > b.v ? a.v : b.v}; }
+inline simd_float andnot(simd_float mask, simd_float a)
+{
+    return {std::bit_cast<float>(~simd_float::bits(mask) & simd_float::bits(a))};
+}
+inline simd_float select(simd_float mask, simd_float a, simd_float b) { return simd_float::bits(mask) ? a : b; }
+inline int movemask(simd_float mask) { return simd_float::bits(mask) ? 1 : 0; }
+inline float hmin(simd_float a) { return a.v; }
+inline void load_deinterleave3(const float *p, simd_float &x, simd_float &y, simd_float &z)
+{
+    x.v = p[0];
+    y.v = p[1];
+    z.v = p[2];
+}
+
+#endif
+
+#endif // SIMD_HPP
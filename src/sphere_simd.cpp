@@ -0,0 +1,267 @@
+
+#include "sphere_simd.hpp"
+#include <bit>
+
+void sphere_soa::build(const std::vector<affine3x4> &object_mdl_from_world,
+    const std::vector<vec<float,4>> &world_spheres,
+    const std::vector<int> &objects, const std::vector<int> &entities)
+{
+    count = int(objects.size());
+    std::size_t padded = std::size_t(count + SIMD_WIDTH);
+
+    // Padding lanes get an all-zero transform: p = d = 0 gives a = 0, disc = 0,
+    // t = NaN, which fails every comparison, so they can never report a hit.
+    // The kernels mask them off by lane index as well.
+    for(int k=0; k<12; k++)
+        rows[k].assign(padded, 0.0f);
+    cx.assign(padded, 0.0f);
+    cy.assign(padded, 0.0f);
+    cz.assign(padded, 0.0f);
+    r2.assign(padded, 0.0f);
+    world.assign(padded, 0);
+    ellipsoids_before.assign(std::size_t(count + 1), 0);
+    entity.assign(padded, -1.0f);
+    object.assign(padded, -1);
+
+    for(int n=0; n<count; n++)
+    {
+        const affine3x4 &iW = object_mdl_from_world[objects[n]];
+        for(int k=0; k<12; k++)
+            rows[k][n] = iW[k];
+
+        const vec<float,4> &ws = world_spheres[objects[n]];
+        world[n] = ws[3] > 0.0f;
+        cx[n] = ws[0];
+        cy[n] = ws[1];
+        cz[n] = ws[2];
+        r2[n] = ws[3]*ws[3];
+        ellipsoids_before[n + 1] = ellipsoids_before[n] + (world[n] ? 0 : 1);
+
+        entity[n] = float(entities[n]);
+        object[n] = objects[n];
+    }
+}
+
+namespace
+{
+
+struct simd_ray
+{
+    simd_float ox, oy, oz;
+    simd_float dx, dy, dz;
+
+    // One ray in every lane
+    simd_ray(const vec<float,3> &pos, const vec<float,3> &dir)
+     : ox(simd_float::set1(pos[0])), oy(simd_float::set1(pos[1])), oz(simd_float::set1(pos[2])),
+       dx(simd_float::set1(dir[0])), dy(simd_float::set1(dir[1])), dz(simd_float::set1(dir[2]))
+    {}
+
+    // One ray per lane
+    explicit simd_ray(const ray_packet &pk)
+     : ox(simd_float::load(pk.ox)), oy(simd_float::load(pk.oy)), oz(simd_float::load(pk.oz)),
+       dx(simd_float::load(pk.dx)), dy(simd_float::load(pk.dy)), dz(simd_float::load(pk.dz))
+    {}
+};
+
+// The same quadratic as sphere_root, evaluated in the same order so each lane's
+// t is bit-identical to the scalar path. Misses come back as -1 or NaN.
+inline simd_float quadratic_roots(simd_float a, simd_float b, simd_float c)
+{
+    simd_float disc = b*b - a*c;
+
+    simd_float sq = sqrt(disc);
+    simd_float t0 = (-b - sq)/a;
+    simd_float t1 = (-b + sq)/a;
+
+    const simd_float EPS = simd_float::set1(1e-4f);
+    const simd_float none = simd_float::set1(-1.0f);
+    simd_float t = select(t0 > EPS, t0, select(t1 > EPS, t1, none));
+    return select(disc >= simd_float::set1(0.0f), t, none);
+}
+
+// Ellipsoid path. m is object_mdl_from_world's affine3x4, one simd_float per element.
+inline simd_float lane_roots(const simd_float *m, const simd_ray &r)
+{
+    simd_float px = m[0]*r.ox + m[1]*r.oy + m[2]*r.oz + m[3];
+    simd_float py = m[4]*r.ox + m[5]*r.oy + m[6]*r.oz + m[7];
+    simd_float pz = m[8]*r.ox + m[9]*r.oy + m[10]*r.oz + m[11];
+
+    simd_float dx = m[0]*r.dx + m[1]*r.dy + m[2]*r.dz;
+    simd_float dy = m[4]*r.dx + m[5]*r.dy + m[6]*r.dz;
+    simd_float dz = m[8]*r.dx + m[9]*r.dy + m[10]*r.dz;
+
+    return quadratic_roots(dx*dx + dy*dy + dz*dz, px*dx + py*dy + pz*dz,
+        px*px + py*py + pz*pz - simd_float::set1(1.0f));
+}
+
+// World sphere path, no transforms
+inline simd_float world_roots(simd_float cx, simd_float cy, simd_float cz, simd_float r2,
+    const simd_ray &r)
+{
+    simd_float px = r.ox - cx;
+    simd_float py = r.oy - cy;
+    simd_float pz = r.oz - cz;
+    return quadratic_roots(r.dx*r.dx + r.dy*r.dy + r.dz*r.dz, px*r.dx + py*r.dy + pz*r.dz,
+        px*px + py*py + pz*pz - r2);
+}
+
+// Which paths a lane range needs, so all-sphere and all-ellipsoid ranges only pay for one
+enum range_kind
+{
+    RANGE_MIXED = 0,
+    RANGE_WORLD,
+    RANGE_ELLIPSOID
+};
+
+inline range_kind classify_range(const sphere_soa &soa, int begin, int end)
+{
+    int e = soa.ellipsoids(begin, end);
+    if(e == 0) return RANGE_WORLD;
+    if(e == end - begin) return RANGE_ELLIPSOID;
+    return RANGE_MIXED;
+}
+
+// SIMD_WIDTH spheres starting at lane n
+inline simd_float lane_roots(const sphere_soa &soa, int n, const simd_ray &r, range_kind kind)
+{
+    simd_float tw, te;
+    simd_float r2 = simd_float::load(soa.r2.data() + n);
+    if(kind != RANGE_ELLIPSOID)
+    {
+        tw = world_roots(simd_float::load(soa.cx.data() + n), simd_float::load(soa.cy.data() + n),
+            simd_float::load(soa.cz.data() + n), r2, r);
+        if(kind == RANGE_WORLD) return tw;
+    }
+
+    simd_float m[12];
+    for(int k=0; k<12; k++)
+        m[k] = simd_float::load(soa.rows[k].data() + n);
+    te = lane_roots(m, r);
+    if(kind == RANGE_ELLIPSOID) return te;
+
+    // r2 is 0 on ellipsoid lanes
+    return select(r2 > simd_float::set1(0.0f), tw, te);
+}
+
+// Sphere n broadcast to every lane
+inline simd_float sphere_roots(const sphere_soa &soa, int n, const simd_ray &r)
+{
+    if(soa.world[n])
+    {
+        return world_roots(simd_float::set1(soa.cx[n]), simd_float::set1(soa.cy[n]),
+            simd_float::set1(soa.cz[n]), simd_float::set1(soa.r2[n]), r);
+    }
+    simd_float m[12];
+    for(int k=0; k<12; k++)
+        m[k] = simd_float::set1(soa.rows[k][n]);
+    return lane_roots(m, r);
+}
+
+} // namespace
+
+int sphere_soa_closest(const sphere_soa &soa, int begin, int end,
+    const vec<float,3> &pos, const vec<float,3> &dir, int skip_entity, float &t_max)
+{
+    simd_ray r(pos, dir);
+    const simd_float zero = simd_float::set1(0.0f);
+    const simd_float skip = simd_float::set1(float(skip_entity));
+    const simd_float last = simd_float::set1(float(end));
+    const range_kind kind = classify_range(soa, begin, end);
+
+    // Per-lane running minimum; lanes only ever see their own candidates
+    simd_float best_t = simd_float::set1(t_max);
+    simd_float best_lane = simd_float::set1(-1.0f);
+    for(int n=begin; n<end; n+=SIMD_WIDTH)
+    {
+        simd_float t = lane_roots(soa, n, r, kind);
+        simd_float lane = simd_float::iota() + simd_float::set1(float(n));
+        simd_float hit = (t > zero) & (t < best_t) & (lane < last)
+            & (simd_float::load(soa.entity.data() + n) != skip);
+        best_t = select(hit, t, best_t);
+        best_lane = select(hit, lane, best_lane);
+    }
+
+    // Masked min-reduction across lanes
+    float t_min = hmin(best_t);
+    if(!(t_min < t_max)) return -1;
+
+    int winner = std::countr_zero(unsigned(movemask(best_t == simd_float::set1(t_min))));
+    float lanes[SIMD_WIDTH];
+    best_lane.store(lanes);
+
+    t_max = t_min;
+    return int(lanes[winner]);
+}
+
+bool sphere_soa_any(const sphere_soa &soa, int begin, int end,
+    const vec<float,3> &pos, const vec<float,3> &dir, int skip_entity, float t_max)
+{
+    simd_ray r(pos, dir);
+    const simd_float zero = simd_float::set1(0.0f);
+    const simd_float skip = simd_float::set1(float(skip_entity));
+    const simd_float last = simd_float::set1(float(end));
+    const simd_float tmax = simd_float::set1(t_max);
+    const range_kind kind = classify_range(soa, begin, end);
+
+    for(int n=begin; n<end; n+=SIMD_WIDTH)
+    {
+        simd_float t = lane_roots(soa, n, r, kind);
+        simd_float lane = simd_float::iota() + simd_float::set1(float(n));
+        simd_float hit = (t > zero) & (t < tmax) & (lane < last)
+            & (simd_float::load(soa.entity.data() + n) != skip);
+        if(movemask(hit))
+            return true;
+    }
+    return false;
+}
+
+void sphere_soa_closest(const sphere_soa &soa, int begin, int end, ray_packet &pk)
+{
+    simd_ray r(pk);
+    const simd_float zero = simd_float::set1(0.0f);
+    const simd_float skip = simd_float::load(pk.skip);
+    const simd_float live = lane_mask(pk.active);
+
+    simd_float best_t = simd_float::load(pk.t_max);
+    simd_float best_prim = simd_float::set1(-1.0f);
+    for(int n=begin; n<end; n++)
+    {
+        simd_float t = sphere_roots(soa, n, r);
+        simd_float hit = (t > zero) & (t < best_t) & live
+            & (simd_float::set1(soa.entity[n]) != skip);
+        best_t = select(hit, t, best_t);
+        best_prim = select(hit, simd_float::set1(float(n)), best_prim);
+    }
+
+    float prims[SIMD_WIDTH];
+    best_prim.store(prims);
+    best_t.store(pk.t_max);
+    for(int lane=0; lane<SIMD_WIDTH; lane++)
+        if(prims[lane] >= 0.0f)
+            pk.prim[lane] = int(prims[lane]);
+}
+
+int sphere_soa_any(const sphere_soa &soa, int begin, int end, const ray_packet &pk, int live)
+{
+    simd_ray r(pk);
+    const simd_float zero = simd_float::set1(0.0f);
+    const simd_float skip = simd_float::load(pk.skip);
+    const simd_float tmax = simd_float::load(pk.t_max);
+
+    int blocked = 0;
+    simd_float open = lane_mask(live);
+    for(int n=begin; n<end; n++)
+    {
+        simd_float t = sphere_roots(soa, n, r);
+        simd_float hit = (t > zero) & (t < tmax) & open
+            & (simd_float::set1(soa.entity[n]) != skip);
+        int bits = movemask(hit);
+        if(bits)
+        {
+            blocked |= bits;
+            if(blocked == live) break;
+            open = lane_mask(live & ~blocked);
+        }
+    }
+    return blocked;
+}
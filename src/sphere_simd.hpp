@@ -0,0 +1,60 @@
+#ifndef SPHERE_SIMD_HPP
+#define SPHERE_SIMD_HPP
+
+#include <vector>
+#include "vec.hpp"
+#include "simd.hpp"
+#include "packet.hpp"
+#include "affine.hpp"
+
+// Structure-of-arrays copy of each sphere's object_mdl_from_world, so one ray can be tested against SIMD_WIDTH spheres
+// per iteration. Lane order is whatever order the caller builds with; the BVH
+// builds it in its own leaf order so a leaf is one contiguous run of lanes.
+struct sphere_soa
+{
+    int count = 0;
+
+    // rows[4*i + j] holds iW[4*i + j] for every lane. Padded by SIMD_WIDTH so
+    // unaligned loads at any start lane stay in bounds.
+    std::vector<float> rows[12];
+
+    // World center and squared radius for lanes that are plain spheres. Ranges with
+    // no ellipsoid in them skip the transform rows entirely.
+    std::vector<float> cx, cy, cz, r2;
+    std::vector<unsigned char> world;   // 1 if the lane is a world-space sphere
+    std::vector<int> ellipsoids_before; // Prefix count of non-world lanes, count+1 entries
+
+    std::vector<float> entity; // Entity id per lane, as float (exact below 2^24)
+    std::vector<int> object;   // Index into render_scene::objects per lane
+
+    // world_spheres[objects[n]] is center and radius, radius 0 for anything that
+    // has to go through object_mdl_from_world.
+    void build(const std::vector<affine3x4> &object_mdl_from_world,
+        const std::vector<vec<float,4>> &world_spheres,
+        const std::vector<int> &objects, const std::vector<int> &entities);
+
+    int ellipsoids(int begin, int end) const
+    {
+        return ellipsoids_before[std::size_t(end)] - ellipsoids_before[std::size_t(begin)];
+    }
+};
+
+// Nearest root in (EPS, t_max) over lanes [begin,end), skipping lanes whose entity
+// is skip_entity. Returns the lane and shrinks t_max, or returns -1.
+// t is the ray parameter, which is the world distance for a normalized dir.
+int sphere_soa_closest(const sphere_soa &soa, int begin, int end,
+    const vec<float,3> &pos, const vec<float,3> &dir, int skip_entity, float &t_max);
+
+// True as soon as any lane in [begin,end) has a root in (EPS, t_max).
+bool sphere_soa_any(const sphere_soa &soa, int begin, int end,
+    const vec<float,3> &pos, const vec<float,3> &dir, int skip_entity, float t_max);
+
+// Packet versions: one sphere at a time against every lane, so each transform is
+// loaded once per packet instead of once per ray.
+// Closest: shrinks the live lanes' t_max and sets their prim to the SoA lane hit.
+void sphere_soa_closest(const sphere_soa &soa, int begin, int end, ray_packet &pk);
+
+// Any: returns the lanes in live that are blocked by a sphere in [begin,end).
+int sphere_soa_any(const sphere_soa &soa, int begin, int end, const ray_packet &pk, int live);
+
+#endif // SPHERE_SIMD_HPP
@@ -0,0 +1,149 @@
+
+#include "stats.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <locale>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+std::mutex stats_lock;
+ray_counters exited_threads;
+std::vector<const ray_counters*> live_threads;
+std::vector<std::pair<std::string, double>> stage_times;
+
+std::string json_string(const std::string &s)
+{
+    std::string out = "\"";
+    for(char c : s)
+    {
+        if(c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if(std::uint8_t(c) < 0x20)
+        {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", unsigned(std::uint8_t(c)));
+            out += buf;
+        }
+        else
+            out += c;
+    }
+    return out + "\"";
+}
+
+const char *compiler_version()
+{
+#ifdef __VERSION__
+    return __VERSION__;
+#else
+    return "unknown";
+#endif
+}
+
+const char *simd_isa()
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__AVX__)
+    return "avx";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace
+
+ray_stats_scope::ray_stats_scope()
+{
+    std::lock_guard<std::mutex> guard(stats_lock);
+    live_threads.push_back(&ray_stats);
+}
+
+ray_stats_scope::~ray_stats_scope()
+{
+    std::lock_guard<std::mutex> guard(stats_lock);
+    exited_threads.add(ray_stats);
+    live_threads.erase(std::find(live_threads.begin(), live_threads.end(), &ray_stats));
+}
+
+ray_counters ray_stats_total()
+{
+    std::lock_guard<std::mutex> guard(stats_lock);
+    ray_counters total = exited_threads;
+    for(const ray_counters *counters : live_threads)
+        total.add(*counters);
+    return total;
+}
+
+void add_stage_time(const char *stage, double seconds)
+{
+    std::lock_guard<std::mutex> guard(stats_lock);
+    for(auto &[name, total] : stage_times)
+    {
+        if(name == stage)
+        {
+            total += seconds;
+            return;
+        }
+    }
+    stage_times.emplace_back(stage, seconds);
+}
+
+std::wstring write_stats_json(const std::string &path, const stats_run_info &run)
+{
+    ray_counters rays = ray_stats_total();
+    std::vector<std::pair<std::string, double>> stages;
+    {
+        std::lock_guard<std::mutex> guard(stats_lock);
+        stages = stage_times;
+    }
+    double render_s = 0.0;
+    for(const auto &[name, seconds] : stages)
+        if(name == "render")
+            render_s = seconds;
+    auto per_second = [&](double n) { return render_s > 0.0 ? n/render_s : 0.0; };
+
+    std::ofstream file(path, std::ios::trunc);
+    if(!file.is_open())
+        return L"Error opening stats file";
+    file.imbue(std::locale::classic());
+    file.precision(9);
+
+    file << "{\n";
+    file << "  \"run\": {\"scene\": " << json_string(run.scene)
+         << ", \"width\": " << run.width << ", \"height\": " << run.height
+         << ", \"threads\": " << run.threads << ", \"spp\": " << run.spp
+         << ", \"accel\": " << json_string(run.accel)
+         << ", \"sampler\": " << json_string(run.sampler)
+         << ", \"packets\": " << (run.packets ? "true" : "false") << "},\n";
+#ifdef UTAH_HEADLESS
+    const char *headless = "true";
+#else
+    const char *headless = "false";
+#endif
+    file << "  \"build\": {\"compiler\": " << json_string(compiler_version())
+         << ", \"simd\": " << json_string(simd_isa()) << ", \"simd_width\": " << SIMD_WIDTH
+         << ", \"headless\": " << headless << "},\n";
+
+    file << "  \"stages\": {";
+    for(std::size_t n=0; n<stages.size(); n++)
+        file << (n ? ", " : "") << json_string(stages[n].first) << ": " << stages[n].second;
+    file << "},\n";
+
+    file << "  \"rays\": {\"primary\": " << rays.primary << ", \"shadow\": " << rays.shadow
+         << ", \"object_tests\": " << rays.object_tests << ", \"hits\": " << rays.hits
+         << ", \"shadow_blocked\": " << rays.shadow_blocked << "},\n";
+    file << "  \"rays_per_second\": " << per_second(double(rays.primary + rays.shadow))
+         << ",\n  \"samples_per_second\": " << per_second(double(rays.primary)) << "\n}\n";
+    return file ? L"" : L"Error writing stats file";
+}
@@ -0,0 +1,96 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include "trace.hpp"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// Always-on run statistics: wall time per pipeline stage and ray counters,
+// written out as JSON by --stats for dashboards to track rays/second per build.
+
+// Plain data so the thread_local below is zero-initialized with no TLS init
+// guard in front of every increment. Locals want a {} to start at zero.
+struct ray_counters
+{
+    std::uint64_t primary;        // Camera rays
+    std::uint64_t shadow;         // Any-hit rays toward lights
+    std::uint64_t object_tests;   // Ray-object intersection tests, a packet counts each live lane
+    std::uint64_t hits;           // Camera rays that hit something
+    std::uint64_t shadow_blocked; // Shadow rays that hit something
+
+    void add(const ray_counters &o)
+    {
+        primary += o.primary;
+        shadow += o.shadow;
+        object_tests += o.object_tests;
+        hits += o.hits;
+        shadow_blocked += o.shadow_blocked;
+    }
+};
+
+static_assert(std::is_trivially_default_constructible_v<ray_counters>);
+
+// Each thread bumps its own copy with plain adds
+inline thread_local ray_counters ray_stats;
+
+// Counts the calling thread's ray_stats in the totals while it is alive, and
+// folds them in for good when it ends. tile_pool workers hold one for their
+// whole life; main and the GUI render thread take one explicitly. Rays on a
+// thread without one go uncounted.
+struct ray_stats_scope
+{
+    ray_stats_scope();
+    ray_stats_scope(const ray_stats_scope&) = delete;
+    ray_stats_scope& operator=(const ray_stats_scope&) = delete;
+    ~ray_stats_scope();
+};
+
+// Sum over every counted thread. Call while no rays are being traced
+// (between tile_pool runs).
+ray_counters ray_stats_total();
+
+// Adds seconds to a named stage. Stages are reported in the order they first
+// show up; a stage that runs more than once (display uploads) sums up.
+void add_stage_time(const char *stage, double seconds);
+
+// Times one stage from construction to stop() or the end of the scope. Stages
+// are also trace events when tracing is built in.
+struct stage_timer
+{
+    const char *stage;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    explicit stage_timer(const char *name) : stage(name) {}
+    ~stage_timer() { stop(); }
+
+    void stop()
+    {
+        if(!stage) return;
+        auto end = std::chrono::steady_clock::now();
+        add_stage_time(stage, std::chrono::duration<double>(end - start).count());
+        TRACE_RECORD(stage, start, end);
+        stage = nullptr;
+    }
+};
+
+// What was rendered, for the JSON's "run" object
+struct stats_run_info
+{
+    std::string scene;
+    std::string accel;
+    std::string sampler;
+    int width = 0, height = 0;
+    int threads = 0;
+    int spp = 0; // Cap, pixels may have taken fewer
+    bool packets = false;
+};
+
+// {"run": {...}, "build": {...}, "stages": {"read_xml": s, ...},
+//  "rays": {"primary": n, ...}, "rays_per_second": r, "samples_per_second": r}
+// Every sample is one primary ray. Per-second rates are over the "render"
+// stage. Empty string on success.
+std::wstring write_stats_json(const std::string &path, const stats_run_info &run);
+
+#endif // STATS_HPP
@@ -0,0 +1,185 @@
+
+#include "tonemap.hpp"
+#include "simd.hpp"
+#include "scheduler.hpp"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+const int TONEMAP_BAND_ROWS = 16;
+
+float apply_curve(transfer_curve curve, float x)
+{
+    if(curve == TRANSFER_SRGB)
+        return (x <= 0.0031308f) ? 12.92f*x : 1.055f*std::pow(x, 1.0f/2.4f) - 0.055f;
+    return std::pow(x, 1.0f/2.2f);
+}
+
+// The old per-sample saturationClip went rgb -> hsv, scaled s and v by 1/v,
+// and went back. With v = max(r,g,b) that works out to c' = 1 - (v - c)/v^2 per
+// channel, which needs no hue sector and vectorizes as is. The upper clamp
+// only keeps v*v finite.
+void saturation_clip(simd_float &r, simd_float &g, simd_float &b)
+{
+    const simd_float zero = simd_float::set1(0.0f);
+    const simd_float one = simd_float::set1(1.0f);
+    const simd_float big = simd_float::set1(1e18f);
+    r = min(max(r, zero), big);
+    g = min(max(g, zero), big);
+    b = min(max(b, zero), big);
+
+    simd_float v = max(max(r, g), b);
+    simd_float over = v > one;
+    simd_float inv_v2 = one/(v*v);
+    r = select(over, one - (v - r)*inv_v2, r);
+    g = select(over, one - (v - g)*inv_v2, g);
+    b = select(over, one - (v - b)*inv_v2, b);
+}
+
+// Largest float below 1. Clamping to [2^-24, this] before the lookup lets the
+// table index come straight off the bits with no range checks; both ends land
+// in buckets that encode to 0 and 255 like tonemapper::encode does.
+const float LUT_MAX_INPUT = 0x1.fffffep-1f;
+
+// Clips rows [y0,y1) SIMD_WIDTH pixels at a time and hands store(p0, count, r, g, b)
+// the clamped linear values of pixels p0 .. p0+count-1.
+template<typename Store>
+void tonemap_rows(const float *rgb, int w, int y0, int y1, Store &&store)
+{
+    const simd_float lo = simd_float::set1(std::bit_cast<float>(TONEMAP_LUT_MIN_BITS));
+    const simd_float hi = simd_float::set1(LUT_MAX_INPUT);
+    alignas(32) float tail[3*SIMD_WIDTH];
+    for(int y=y0; y<y1; y++)
+    for(int x=0; x<w; x+=SIMD_WIDTH)
+    {
+        int count = std::min(SIMD_WIDTH, w - x);
+        std::size_t p0 = std::size_t(y)*std::size_t(w) + std::size_t(x);
+        const float *src = rgb + p0*3;
+        if(count < SIMD_WIDTH)
+        {
+            // Row end: pad with the last pixel so every lane holds a real color
+            for(int lane=0; lane<SIMD_WIDTH; lane++)
+                for(int c=0; c<3; c++)
+                    tail[lane*3 + c] = src[std::min(lane, count - 1)*3 + c];
+            src = tail;
+        }
+
+        simd_float r, g, b;
+        load_deinterleave3(src, r, g, b);
+        saturation_clip(r, g, b);
+        store(p0, count, min(max(r, lo), hi), min(max(g, lo), hi), min(max(b, lo), hi));
+    }
+}
+
+// Table index of each clamped lane, via the float bits
+void lut_indices(simd_float x, std::uint32_t out[SIMD_WIDTH])
+{
+    alignas(32) float f[SIMD_WIDTH];
+    x.store(f);
+    for(int lane=0; lane<SIMD_WIDTH; lane++)
+        out[lane] = (std::bit_cast<std::uint32_t>(f[lane]) - TONEMAP_LUT_MIN_BITS) >> (23 - TONEMAP_LUT_MANTISSA_BITS);
+}
+
+// Full-width bands of rows, so the tile pool can spread the pass over threads
+template<typename Store>
+void tonemap_parallel(const float *rgb, int w, int h, tile_pool &pool, Store &&store)
+{
+    std::vector<tile> bands;
+    for(int y=0; y<h; y+=TONEMAP_BAND_ROWS)
+        bands.push_back(tile{int(bands.size()), 0, y, w, std::min(h, y + TONEMAP_BAND_ROWS)});
+
+    pool.run(bands, [&](const tile &t, int tid)
+    {
+        tonemap_rows(rgb, w, t.y0, t.y1, store);
+    });
+}
+
+} // namespace
+
+tonemapper make_tonemapper(transfer_curve curve)
+{
+    tonemapper tm;
+    tm.curve = curve;
+
+    // One entry per bucket, valued at the bucket's midpoint
+    const int shift = 23 - TONEMAP_LUT_MANTISSA_BITS;
+    std::size_t entries = std::size_t((TONEMAP_LUT_ONE_BITS - TONEMAP_LUT_MIN_BITS) >> shift);
+    tm.lut.resize(entries + 3); // Slack for 4-byte gathers off the last entry
+    for(std::size_t n=0; n<entries; n++)
+    {
+        std::uint32_t lo = TONEMAP_LUT_MIN_BITS + (std::uint32_t(n) << shift);
+        std::uint32_t hi = lo + (1u << shift);
+        float mid = 0.5f*(std::bit_cast<float>(lo) + std::bit_cast<float>(hi));
+        float code = std::round(apply_curve(curve, mid)*255.0f);
+        tm.lut[n] = std::uint8_t(std::clamp(code, 0.0f, 255.0f));
+    }
+    return tm;
+}
+
+bool parse_transfer_curve(const std::string &name, transfer_curve &curve)
+{
+    if(name == "gamma") curve = TRANSFER_GAMMA22;
+    else if(name == "srgb") curve = TRANSFER_SRGB;
+    else return false;
+    return true;
+}
+
+void tonemap_rgb8(const tonemapper &tm, const float *rgb, int w, int h, std::uint8_t *out, tile_pool &pool)
+{
+    const std::uint8_t *lut = tm.lut.data();
+    tonemap_parallel(rgb, w, h, pool, [&](std::size_t p0, int count, simd_float r, simd_float g, simd_float b)
+    {
+        std::uint32_t ir[SIMD_WIDTH], ig[SIMD_WIDTH], ib[SIMD_WIDTH];
+        lut_indices(r, ir);
+        lut_indices(g, ig);
+        lut_indices(b, ib);
+        std::uint8_t *dst = out + p0*3;
+        for(int lane=0; lane<count; lane++)
+        {
+            dst[lane*3 + 0] = lut[ir[lane]];
+            dst[lane*3 + 1] = lut[ig[lane]];
+            dst[lane*3 + 2] = lut[ib[lane]];
+        }
+    });
+}
+
+void tonemap_rgba8(const tonemapper &tm, const float *rgb, int w, int h, void *out, int pitch, tile_pool &pool)
+{
+    const std::uint8_t *lut = tm.lut.data();
+    tonemap_parallel(rgb, w, h, pool, [&](std::size_t p0, int count, simd_float r, simd_float g, simd_float b)
+    {
+        std::size_t y = p0/std::size_t(w), x = p0 - y*std::size_t(w);
+        std::uint32_t *dst = reinterpret_cast<std::uint32_t*>(static_cast<std::uint8_t*>(out) + y*std::size_t(pitch)) + x;
+#if defined(__AVX2__)
+        if(count == SIMD_WIDTH)
+        {
+            // Gather 4 bytes at each index (the table is padded for it) and keep the low one
+            const __m256i min_bits = _mm256_set1_epi32(int(TONEMAP_LUT_MIN_BITS));
+            const __m256i low = _mm256_set1_epi32(0xFF);
+            auto code = [&](simd_float c)
+            {
+                __m256i idx = _mm256_srli_epi32(_mm256_sub_epi32(_mm256_castps_si256(c.v), min_bits), 23 - TONEMAP_LUT_MANTISSA_BITS);
+                return _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), idx, 1), low);
+            };
+            __m256i px = _mm256_or_si256(
+                _mm256_or_si256(_mm256_slli_epi32(code(r), 24), _mm256_slli_epi32(code(g), 16)),
+                _mm256_or_si256(_mm256_slli_epi32(code(b), 8), low));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), px);
+            return;
+        }
+#endif
+        std::uint32_t ir[SIMD_WIDTH], ig[SIMD_WIDTH], ib[SIMD_WIDTH];
+        lut_indices(r, ir);
+        lut_indices(g, ig);
+        lut_indices(b, ib);
+        for(int lane=0; lane<count; lane++)
+            dst[lane] = (std::uint32_t(lut[ir[lane]]) << 24) | (std::uint32_t(lut[ig[lane]]) << 16)
+                      | (std::uint32_t(lut[ib[lane]]) << 8) | 255u;
+    });
+}
@@ -0,0 +1,59 @@
+#ifndef TONEMAP_HPP
+#define TONEMAP_HPP
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct tile_pool;
+
+// Linear HDR radiance to display pixels. The renderer accumulates linear
+// radiance and this runs once over the averaged framebuffer, for file output
+// and for the SDL texture alike:
+//   1. saturation clip: colors brighter than 1 keep their hue and lose saturation
+//   2. transfer curve (gamma 2.2 or sRGB) through a table keyed on float bits
+//   3. 8-bit pack
+
+enum transfer_curve : std::uint8_t
+{
+    TRANSFER_GAMMA22,
+    TRANSFER_SRGB,
+};
+
+// The table covers [2^-24, 1) with 2^8 buckets per octave, so encode is one
+// subtract and shift off the float's bits and stays within half an LSB of the
+// exact curve. Below 2^-24 is 0, 1 and up is 255.
+const int TONEMAP_LUT_MANTISSA_BITS = 8;
+const std::uint32_t TONEMAP_LUT_MIN_BITS = 0x33800000u; // 2^-24
+const std::uint32_t TONEMAP_LUT_ONE_BITS = 0x3f800000u; // 1.0f
+
+struct tonemapper
+{
+    transfer_curve curve = TRANSFER_GAMMA22;
+    std::vector<std::uint8_t> lut;
+
+    // Linear [0,1] to an 8-bit code
+    std::uint8_t encode(float x) const
+    {
+        std::uint32_t bits = std::bit_cast<std::uint32_t>(x);
+        if(bits < TONEMAP_LUT_MIN_BITS) return 0;
+        if(bits >= TONEMAP_LUT_ONE_BITS) return 255;
+        return lut[(bits - TONEMAP_LUT_MIN_BITS) >> (23 - TONEMAP_LUT_MANTISSA_BITS)];
+    }
+};
+
+tonemapper make_tonemapper(transfer_curve curve);
+
+// "gamma" or "srgb"; false if name is neither.
+bool parse_transfer_curve(const std::string &name, transfer_curve &curve);
+
+// rgb is w*h interleaved linear RGB, rows top to bottom. Bands of rows are
+// split across pool's workers.
+void tonemap_rgb8(const tonemapper &tm, const float *rgb, int w, int h, std::uint8_t *out, tile_pool &pool);
+
+// Same, packed as SDL_PIXELFORMAT_RGBA8888: (r<<24)|(g<<16)|(b<<8)|255, with rows
+// `pitch` bytes apart so it can write straight into a locked texture.
+void tonemap_rgba8(const tonemapper &tm, const float *rgb, int w, int h, void *out, int pitch, tile_pool &pool);
+
+#endif // TONEMAP_HPP
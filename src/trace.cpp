@@ -0,0 +1,115 @@
+
+#include "trace.hpp"
+
+#ifdef UTAH_TRACE
+
+#include <fstream>
+#include <locale>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+
+struct trace_event
+{
+    const char *name;
+    std::uint64_t start_ns, dur_ns; // From trace_epoch
+    std::int64_t arg;
+};
+
+// Only its owner thread writes it, and it is only read while the owner is
+// between tile_pool runs, so head needs no atomics.
+struct trace_ring
+{
+    int id = 0;
+    std::string name;
+    std::vector<trace_event> events = std::vector<trace_event>(std::size_t(1) << TRACE_RING_BITS);
+    std::uint64_t head = 0; // Events ever written
+};
+
+const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+std::mutex trace_lock;
+std::vector<std::unique_ptr<trace_ring>> rings;
+
+thread_local trace_ring *owned_ring = nullptr;
+
+trace_ring *thread_ring()
+{
+    if(owned_ring) return owned_ring;
+    std::lock_guard<std::mutex> guard(trace_lock);
+    rings.push_back(std::make_unique<trace_ring>());
+    rings.back()->id = int(rings.size()) - 1;
+    rings.back()->name = "thread " + std::to_string(rings.back()->id);
+    owned_ring = rings.back().get();
+    return owned_ring;
+}
+
+std::uint64_t since_epoch_ns(std::chrono::steady_clock::time_point t)
+{
+    if(t < trace_epoch) return 0;
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(t - trace_epoch).count());
+}
+
+} // namespace
+
+void trace_thread_name(const char *prefix, int id)
+{
+    trace_ring *ring = thread_ring();
+    std::lock_guard<std::mutex> guard(trace_lock);
+    ring->name = std::string(prefix) + " " + std::to_string(id);
+}
+
+void trace_record(const char *name, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end, std::int64_t arg)
+{
+    trace_ring *ring = thread_ring();
+    std::uint64_t s = since_epoch_ns(start), e = since_epoch_ns(end);
+    const std::uint64_t mask = (std::uint64_t(1) << TRACE_RING_BITS) - 1;
+    ring->events[ring->head & mask] = trace_event{name, s, e - s, arg};
+    ring->head++;
+}
+
+std::wstring write_trace_json(const std::string &path)
+{
+    std::ofstream file(path, std::ios::trunc);
+    if(!file.is_open())
+        return L"Error opening trace file";
+    file.imbue(std::locale::classic());
+    file.setf(std::ios::fixed);
+    file.precision(3);
+
+    std::lock_guard<std::mutex> guard(trace_lock);
+    const std::uint64_t size = std::uint64_t(1) << TRACE_RING_BITS;
+    bool first = true;
+    auto separator = [&]() -> const char*
+    {
+        const char *sep = first ? "\n" : ",\n";
+        first = false;
+        return sep;
+    };
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for(const std::unique_ptr<trace_ring> &ring : rings)
+    {
+        file << separator() << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring->id
+             << ", \"args\": {\"name\": \"" << ring->name << "\"}}";
+
+        std::uint64_t begin = ring->head > size ? ring->head - size : 0;
+        for(std::uint64_t n=begin; n<ring->head; n++)
+        {
+            const trace_event &ev = ring->events[n & (size - 1)];
+            file << separator() << "{\"name\": \"" << ev.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << ring->id
+                 << ", \"ts\": " << double(ev.start_ns)*1e-3 << ", \"dur\": " << double(ev.dur_ns)*1e-3;
+            if(ev.arg >= 0)
+                file << ", \"args\": {\"id\": " << ev.arg << "}";
+            file << "}";
+        }
+    }
+    file << "\n]}\n";
+    return file ? L"" : L"Error writing trace file";
+}
+
+#endif // UTAH_TRACE
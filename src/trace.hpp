@@ -0,0 +1,61 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+// Timeline of what every thread was doing, dumped as Chrome trace_event JSON
+// (chrome://tracing or ui.perfetto.dev) to spot load imbalance and stalls.
+// Only built with make TRACE=1 (-DUTAH_TRACE); otherwise the macros below are
+// empty and nothing here exists.
+//
+// Every thread writes complete events into its own ring buffer, so recording
+// is a clock read and a store with no locks. The only lock is taken once per
+// thread, to get a ring. A thread keeps its ring for good, so each ring is one
+// row of the timeline: one per tile_pool worker, plus the main, render and
+// display threads. A full ring overwrites its oldest events.
+
+#ifdef UTAH_TRACE
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+const int TRACE_RING_BITS = 16; // 2^16 events of 32 bytes per ring
+
+// Records [start, end) as an event named name (a string literal, only the
+// pointer is kept) on the calling thread's ring. arg < 0 is left out of the JSON.
+void trace_record(const char *name, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end, std::int64_t arg = -1);
+
+// Labels the calling thread's row "prefix id" instead of "thread <ring>"
+void trace_thread_name(const char *prefix, int id);
+
+// Writes every ring as trace_event JSON. Call while no traced work is running
+// (between tile_pool runs). Empty string on success.
+std::wstring write_trace_json(const std::string &path);
+
+struct trace_scope
+{
+    const char *name;
+    std::int64_t arg;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    explicit trace_scope(const char *event, std::int64_t event_arg = -1) : name(event), arg(event_arg) {}
+    ~trace_scope() { trace_record(name, start, std::chrono::steady_clock::now(), arg); }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name, std::int64_t(arg))
+#define TRACE_RECORD(name, start, end) trace_record(name, start, end)
+#define TRACE_THREAD_NAME(prefix, id) trace_thread_name(prefix, id)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_ARG(name, arg) ((void)0)
+#define TRACE_RECORD(name, start, end) ((void)0)
+#define TRACE_THREAD_NAME(prefix, id) ((void)0)
+
+#endif // UTAH_TRACE
+
+#endif // TRACE_HPP
@@ -2,7 +2,12 @@
 // Joseph Kessler
 // 2025 December 22
 
+#ifndef VEC_HPP
+#define VEC_HPP
+
 #include <array>
+#include <vector>
+#include <algorithm>
 #include <cstddef>
 #include <cmath>
 
@@ -302,4 +307,6 @@ vec<T,N> ilerp(const vec<T,N>& a, const vec<T,N>& b, const vec<T,N>& x)
     // Not sure how to throw an error if b == a since these are vector types.
     // Lets surprise the user :)
     return (x-a)/dx;
-}
\ No newline at end of file
+}
+
+#endif // VEC_HPP
@@ -1,225 +1,390 @@
 
 #include "xml.hpp"
-#include <sstream>
-#include <fstream>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::~mapped_file()
+{
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+#else
+    if (data) munmap(const_cast<char*>(data), size);
+#endif
+}
 
-std::wstring strip(const std::wstring& str)
+std::wstring mapped_file::open(const std::wstring& path)
 {
-    size_t first = str.find_first_not_of(L" \t\n\r");
-    if (first == std::wstring::npos)
+#ifdef _WIN32
+    HANDLE f = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE)
+        return L"Error opening file";
+    file = f;
+    LARGE_INTEGER len;
+    if (!GetFileSizeEx(f, &len))
+        return L"Error reading file size";
+    size = std::size_t(len.QuadPart);
+    if (size == 0)
+        return L"";
+    mapping = CreateFileMappingW(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+        return L"Error mapping file";
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data)
+        return L"Error mapping file";
+#else
+    int fd = ::open(std::filesystem::path(path).c_str(), O_RDONLY);
+    if (fd < 0)
+        return L"Error opening file";
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return L"Error reading file size";
+    }
+    size = std::size_t(st.st_size);
+    if (size == 0)
+    {
+        ::close(fd);
         return L"";
-    size_t last = str.find_last_not_of(L" \t\n\r");
-    return str.substr(first, (last - first + 1));
+    }
+    void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file alive
+    if (p == MAP_FAILED)
+    {
+        size = 0;
+        return L"Error mapping file";
+    }
+    madvise(p, size, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(p);
+#endif
+    return L"";
 }
 
-struct bound
+std::wstring utf8_to_wide(std::string_view s)
 {
-    int start, stop;
-    bound() : start(-1), stop(-1) {}
-    bound(int s, int e) : start(s), stop(e) {}
-    bound(const bound& b) : start(b.start), stop(b.stop) {}
-
-    bound& operator=(const bound& b)
+    std::wstring out;
+    out.reserve(s.size());
+    for (std::size_t n = 0; n < s.size(); )
     {
-        if (this != &b)
+        unsigned char c = static_cast<unsigned char>(s[n]);
+        char32_t cp;
+        int extra;
+        if (c < 0x80)      { cp = c;        extra = 0; }
+        else if (c < 0xC2) { cp = 0xFFFD;   extra = -1; } // Stray continuation or overlong
+        else if (c < 0xE0) { cp = c & 0x1F; extra = 1; }
+        else if (c < 0xF0) { cp = c & 0x0F; extra = 2; }
+        else if (c < 0xF5) { cp = c & 0x07; extra = 3; }
+        else               { cp = 0xFFFD;   extra = -1; }
+        n++;
+
+        for (int k = 0; k < extra; k++, n++)
         {
-            start = b.start;
-            stop = b.stop;
+            if (n >= s.size() || (static_cast<unsigned char>(s[n]) & 0xC0) != 0x80)
+            {
+                cp = 0xFFFD;
+                break;
+            }
+            cp = (cp << 6) | (static_cast<unsigned char>(s[n]) & 0x3F);
         }
-        return *this;
-    }
-};
-
-struct xml_tag
-{
-    std::wstring name;
-    std::wstring attributes;
-    bool self_closing;
-    bool is_closing;
-    int cid;
-};
 
-enum xml_quote_type
-{
-    XML_QUOTE_SINGLE = 0,
-    XML_QUOTE_DOUBLE = 1
-};
-const wchar_t xml_quote_type_LUT[2] = {L'\'', L'"'};
+        if (sizeof(wchar_t) == 2 && cp >= 0x10000)
+        {
+            cp -= 0x10000;
+            out.push_back(static_cast<wchar_t>(0xD800 + (cp >> 10)));
+            out.push_back(static_cast<wchar_t>(0xDC00 + (cp & 0x3FF)));
+        }
+        else
+            out.push_back(static_cast<wchar_t>(cp));
+    }
+    return out;
+}
 
-struct xml_tag_item
+std::string wide_to_utf8(const std::wstring& s)
 {
-    xml_tag tag;
-    int component_id;
-    xml_tag_item* next, *prev;
-    xml_tag_item() : next(nullptr), prev(nullptr) {}
-    xml_tag_item(const xml_tag& t) : tag(t), next(nullptr), prev(nullptr) {}
-    xml_tag_item(xml_tag_item *prev, xml_tag t) : tag(t), next(nullptr), prev(prev)
-    {
-        if (prev)
-            prev->next = this;
-    }
-    xml_tag_item& operator=(const xml_tag_item& item)
+    std::string out;
+    out.reserve(s.size());
+    for (std::size_t n = 0; n < s.size(); n++)
     {
-        if (this != &item)
+        char32_t cp = static_cast<char32_t>(s[n]);
+        if (sizeof(wchar_t) == 2 && 0xD800 <= cp && cp < 0xDC00 && n + 1 < s.size())
+        {
+            char32_t lo = static_cast<char32_t>(s[n + 1]);
+            if (0xDC00 <= lo && lo < 0xE000)
+            {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                n++;
+            }
+        }
+        if (cp < 0x80)
+            out.push_back(static_cast<char>(cp));
+        else if (cp < 0x800)
+        {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+        else if (cp < 0x10000)
+        {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+        else
         {
-            tag = item.tag;
-            component_id = item.component_id;
-            next = item.next;
-            prev = item.prev;
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
         }
-        return *this;
     }
+    return out;
+}
 
-};
+namespace
+{
 
+// Indexed by xml_atom
+const std::string_view xml_atom_names[XML_ATOM_COUNT] = {
+    "tag", "name", "type",
+    "object", "material", "light", "camera",
+    "fov", "width", "height", "specular", "rotation",
+    "scale", "translate", "position", "target", "up",
+    "diffuse", "glossiness", "intensity", "direction",
+    "value", "angle",
+    "x", "y", "z", "r", "g", "b",
+};
 
-bound find_next_tag(const std::wstring& str, int start_pos)
+std::uint32_t atom_hash(std::string_view s)
 {
-    bound result = bound(start_pos, str.length());
-    size_t open_pos = str.find(L"<", start_pos);
-    if (open_pos == std::wstring::npos)
-        return result;
-    size_t close_pos = str.find(L">", open_pos);
-    if (close_pos == std::wstring::npos)
-        return result;
-    result.start = static_cast<int>(open_pos);
-    result.stop = static_cast<int>(close_pos);
-    return result;
+    std::uint32_t h = 2166136261u; // FNV-1a
+    for (char c : s)
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    return h;
 }
 
+} // namespace
 
-
-// void for now
-xml_tag parse_next_tag(const std::wstring& tag_str, int *start_pos)
+std::string_view xml_atom_name(xml_atom atom)
 {
-    bound tag_bound = find_next_tag(tag_str, *start_pos);
-    if (tag_bound.start == -1 || tag_bound.stop == -1)
-        return xml_tag();
+    if (atom < 0 || atom >= XML_ATOM_COUNT)
+        return std::string_view();
+    return xml_atom_names[atom];
+}
 
-    std::wstring tag_full = tag_str.substr(tag_bound.start, tag_bound.stop - tag_bound.start + 1);
-    std::wstring tag_contents = strip(tag_full).substr(1, tag_full.length() - 2); // Remove < and >
+xml_atom_table::xml_atom_table()
+{
+    slots.assign(64, -1);
+    for (const std::string_view &name : xml_atom_names)
+        intern(name);
+}
 
-    std::wstring tag_name;
-    xml_tag tag;
-    tag.name = tag_contents;
-    tag.self_closing = false;
-    tag.is_closing = false;
+xml_atom xml_atom_table::find(std::string_view s) const
+{
+    std::uint32_t h = atom_hash(s);
+    std::size_t mask = slots.size() - 1;
+    for (std::size_t i = h & mask; slots[i] != -1; i = (i + 1) & mask)
+        if (hashes[slots[i]] == h && names[slots[i]] == s)
+            return static_cast<xml_atom>(slots[i]);
+    return XML_ATOM_NONE;
+}
 
-    // Check if tag is a closing tag
-    if(tag.name[0] == L'/')
-    {
-        tag.is_closing = true;
-        tag.name = strip(tag.name.substr(1));
-    }
+xml_atom xml_atom_table::intern(std::string_view s)
+{
+    std::uint32_t h = atom_hash(s);
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = h & mask;
+    for (; slots[i] != -1; i = (i + 1) & mask)
+        if (hashes[slots[i]] == h && names[slots[i]] == s)
+            return static_cast<xml_atom>(slots[i]);
+
+    int atom = static_cast<int>(names.size());
+    names.push_back(s);
+    hashes.push_back(h);
+    slots[i] = atom;
+    if (2 * names.size() > slots.size())
+        grow(); // Keep probes short
+    return static_cast<xml_atom>(atom);
+}
 
-    // Check if tag is self-closing
-    if(tag.name[tag.name.length() - 1] == L'/')
+void xml_atom_table::grow()
+{
+    slots.assign(slots.size() * 2, -1);
+    std::size_t mask = slots.size() - 1;
+    for (int atom = 0; atom < size(); atom++)
     {
-        // Self-closing tag
-        tag.name = tag.name.substr(0, tag.name.length() - 1);
-        tag.self_closing = true;
+        std::size_t i = hashes[atom] & mask;
+        while (slots[i] != -1) i = (i + 1) & mask;
+        slots[i] = atom;
     }
+}
 
-    tag_contents = strip(tag.name);
-
-    // Find first space if attributes exist
-    int space_pos = tag.name.find(L" ");
-    if(space_pos == std::wstring::npos)
-        space_pos = tag.name.length();
+std::wstring xml_component::wkey() const { return utf8_to_wide(key); }
+std::wstring xml_component::wvalue() const { return utf8_to_wide(value); }
 
-    tag.name = tag.name.substr(0, space_pos);
-    tag.attributes = strip(tag_contents.substr(space_pos));
+namespace
+{
 
-    // Return tag and update start_pos
-    *start_pos = tag_bound.stop + 1;
-    return tag;
+inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
 }
 
-xml_component parse_next_attribute(const std::wstring& attr_str, int *start_pos)
+// [begin, end) without surrounding whitespace
+std::string_view trimmed(const char *begin, const char *end)
 {
-    // Attributes are always in the form `key="val"`, seperated by a space.
-    size_t equal_pos = attr_str.find(L"=", *start_pos);
-
-    xml_component attr;
-    attr.key = strip(attr_str.substr(*start_pos, equal_pos - *start_pos));
-
-    // Find the quote pair
-    xml_quote_type quote_type;
-    if(attr_str[equal_pos + 1] == L'\'') quote_type = XML_QUOTE_SINGLE;
-    else quote_type = XML_QUOTE_DOUBLE;
-
-    wchar_t delim = xml_quote_type_LUT[quote_type];
-    size_t quote_start = attr_str.find(delim, equal_pos + 1) + 1;
-    size_t quote_end = attr_str.find(delim, quote_start + 1) - 1;
-    attr.value = strip(attr_str.substr(quote_start, quote_end - quote_start + 1));
+    while (begin < end && is_space(*begin)) ++begin;
+    while (begin < end && is_space(end[-1])) --end;
+    return std::string_view(begin, std::size_t(end - begin));
+}
 
-    // Update start_pos
-    *start_pos = static_cast<int>(quote_end + 2);
-    return attr;
+const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && is_space(*p)) ++p;
+    return p;
 }
 
-std::wstring parse_all_attributes(const std::wstring& attr_str, std::vector<xml_component> *components, int parent_id)//, std::vector<xml_component>* out_attributes)
+const char *find_char(const char *p, const char *end, char c)
 {
-    if(attr_str.find(L"=") == std::wstring::npos)
-        return L"N/A";
+    const void *hit = std::memchr(p, c, std::size_t(end - p));
+    return hit ? static_cast<const char*>(hit) : end;
+}
 
-    std::wstring result = L"";
-    int pos = 0;
+// Just past the "-->" closing a comment whose "<!--" ends at p, or end
+const char *skip_comment(const char *p, const char *end)
+{
     while (true)
     {
-        if(attr_str.find(L"=", pos) == std::wstring::npos) break;
-        if(pos != 0) result += L", ";
-
-        xml_component attr = parse_next_attribute(attr_str, &pos);
-        attr.id = components->size();
-        attr.parent_id = parent_id;
-        components->push_back(attr);
-
-        result += attr.key + L":" + attr.value;
-        if(attr_str.find(L"=", pos) == std::wstring::npos) // break if no more '=' found
-            break;
+        p = find_char(p, end, '-');
+        if (end - p < 3)
+            return end; // Unterminated comment runs to the end
+        if (p[1] == '-' && p[2] == '>')
+            return p + 3;
+        ++p;
     }
-    return result;
 }
 
-std::vector<xml_component> parse_all_tags(const std::wstring& str, const std::wstring& path)
+// One forward pass over the bytes: every tag and attribute goes straight into
+// the component table as views, keys and tag names interned into atoms, and
+// nothing is looked at twice. Attribute values may contain '>'. A tag left
+// open at the end of the file is dropped.
+std::vector<xml_component> parse_all_tags(std::string_view str, std::string_view path, xml_atom_table &atoms)
 {
     std::vector<xml_component> components;
+    if (str.empty())
+        return components;
+    const char *p = str.data(), *end = p + str.size();
+    int parent_id = -1;
+
+    // Every component comes from a '<' or an '=' (plus the root's name), so
+    // counting those bounds the table. Two memchr sweeps are cheaper than
+    // regrowing it as we go.
+    std::size_t bound = 1;
+    for (char c : {'<', '='})
+        for (const char *q = p; (q = find_char(q, end, c)) != end; ++q)
+            ++bound;
+    components.reserve(bound);
+
+    while (p < end)
+    {
+        p = find_char(p, end, '<');
+        if (p == end)
+            break; // Ran out of file before </xml>
+        ++p;
+        if (end - p >= 3 && p[0] == '!' && p[1] == '-' && p[2] == '-')
+        {
+            p = skip_comment(p + 3, end);
+            continue;
+        }
 
-    int pos = 0;
-    xml_tag tag = parse_next_tag(str, &pos);
-    tag.cid = components.size();
-    xml_component tag_comp(tag.cid, -1, L"tag", tag.name);
-    components.push_back(tag_comp);
-    int parent_id = 0;
-
-    // Manually add a name component for the xml path
-    tag_comp = xml_component(components.size(), parent_id, L"name", path);
-    components.push_back(tag_comp);
+        bool root = components.empty();
+        bool is_closing = false;
+        p = skip_space(p, end);
+        if (p < end && *p == '/')
+        {
+            is_closing = true;
+            p = skip_space(p + 1, end);
+        }
 
-    while (true)
-    {
-        tag = parse_next_tag(str, &pos);
-        if(!tag.is_closing)
+        const char *name_begin = p;
+        while (p < end && !is_space(*p) && *p != '>' && !(*p == '/' && p + 1 < end && p[1] == '>'))
+            ++p;
+        std::string_view name(name_begin, std::size_t(p - name_begin));
+
+        // Manually add a component for the tag we found. The root gets the
+        // xml path as its name and keeps none of its attributes.
+        int tag_id = static_cast<int>(components.size());
+        if (!is_closing)
+            components.emplace_back(tag_id, root ? -1 : parent_id, XML_ATOM_TAG, atoms.intern(name), "tag", name);
+        if (root)
         {
-            // Manually add a component for the tag we found
-            tag_comp = xml_component(components.size(), parent_id, L"tag", tag.name);
-            components.push_back(tag_comp);
+            components.emplace_back(static_cast<int>(components.size()), tag_id, XML_ATOM_NAME, XML_ATOM_NONE, "name", path);
+            parent_id = tag_id;
+        }
+        bool attributes = !is_closing && !root;
 
-            parse_all_attributes(tag.attributes, &components, tag_comp.id);
-            if(!tag.self_closing)
-                parent_id = tag_comp.id;
+        // Attributes are always in the form key="val" (or 'val'), up to the
+        // closing '>'. The last non-space character says if it self-closes.
+        const char *key_begin = p;
+        char last = 0;
+        while (p < end && *p != '>')
+        {
+            char c = *p;
+            if (c != '=')
+            {
+                if (!is_space(c)) last = c;
+                ++p;
+                continue;
+            }
+
+            std::string_view key = trimmed(key_begin, p);
+            p = skip_space(p + 1, end);
+            char delim = (p < end && *p == '\'') ? '\'' : '"';
+            p = find_char(p, end, delim);
+            const char *value_begin = p < end ? p + 1 : end;
+            p = find_char(value_begin, end, delim);
+            if (attributes)
+                components.emplace_back(static_cast<int>(components.size()), tag_id,
+                    atoms.intern(key), XML_ATOM_NONE, key, trimmed(value_begin, p));
+            if (p < end) ++p;
+            key_begin = p;
+            last = delim;
         }
-        else
-            parent_id = components[parent_id].parent_id;
 
-        if(tag.is_closing && tag.name == L"xml")
+        if (p == end)
+        {
+            // Unterminated tag: forget it and anything it carried
+            components.resize(std::size_t(tag_id));
             break;
+        }
+        ++p;
+
+        if (is_closing)
+        {
+            if (parent_id != -1)
+                parent_id = components[parent_id].parent_id;
+            if (name == "xml")
+                break;
+        }
+        else if (!root && last != '/')
+            parent_id = tag_id;
     }
 
     return components;
 }
 
+} // namespace
+
 std::wstring pprint_components(const std::vector<xml_component>& components)
 {
     std::wstring result = L"";
@@ -232,8 +397,8 @@ std::wstring pprint_components(const std::vector<xml_component>& components)
     {
         std::wstring parent_name = L"N/A";
         if (comp.parent_id != -1)
-            parent_name = components[comp.parent_id].value;
-        result += parent_name + L" <- " + comp.key + L": " + comp.value + L"\n";
+            parent_name = components[comp.parent_id].wvalue();
+        result += parent_name + L" <- " + comp.wkey() + L": " + comp.wvalue() + L"\n";
     }
     result += L"\n";
 
@@ -253,7 +418,7 @@ std::wstring pprint_components(const std::vector<xml_component>& components)
 
         std::wstring parent_name = L"N/A";
         if (comp.parent_id != -1)
-            parent_name = components[comp.parent_id].value;
+            parent_name = components[comp.parent_id].wvalue();
 
         // Get the number of tabs required to reach the root (-1)
         int level = 0;
@@ -279,10 +444,10 @@ std::wstring pprint_components(const std::vector<xml_component>& components)
         }
 
         // If the object is a tag, only show value
-        if (components[comp.id].key == L"tag" || comp.parent_id == -1)
-            result += indent + comp.value;// + L"\n";
+        if (comp.key_atom == XML_ATOM_TAG || comp.parent_id == -1)
+            result += indent + comp.wvalue();// + L"\n";
         else
-            result += indent + comp.key + L": " + comp.value;// + L"\n";
+            result += indent + comp.wkey() + L": " + comp.wvalue();// + L"\n";
         
         // If there are no children here, print that, otherwise return.
         //if(leaves_clone[n] == 0) result += L" <-- Data!";
@@ -292,37 +457,15 @@ std::wstring pprint_components(const std::vector<xml_component>& components)
     return result;
 }
 
-std::wstring read_xml(std::vector<xml_component>& components, const std::wstring& path)
+std::wstring read_xml(xml_document& doc, const std::wstring& path)
 {
-    std::wifstream file(path.c_str());
-    if (!file.is_open()) {
-        return L"Error opening file";
-    }
-
-    std::wstring content((std::istreambuf_iterator<wchar_t>(file)),
-                          std::istreambuf_iterator<wchar_t>());
-    file.close();
-
-    // Purge XML comments: remove all <!-- ... --> blocks (may be multiline)
-    size_t pos = 0;
-    while (true)
-    {
-        size_t start = content.find(L"<!--", pos);
-        if (start == std::wstring::npos) break;
-        size_t end = content.find(L"-->", start + 4);
-        if (end == std::wstring::npos)
-        {
-            // unterminated comment: remove until end of string
-            content.erase(start);
-            break;
-        }
-        // erase comment including the closing "-->"
-        content.erase(start, end - start + 3);
-        // continue scanning from the same start position (new content there)
-        pos = start;
-    }
+    // Mapped rather than read: the components are views straight into the file
+    std::wstring err = doc.file.open(path);
+    if (err != L"")
+        return err;
 
-    components = parse_all_tags(content, path);
+    doc.path = wide_to_utf8(path);
+    doc.components = parse_all_tags(doc.file.bytes(), doc.path, doc.atoms);
 
     return L"";
 }
@@ -332,9 +475,9 @@ std::wstring xml_test()
     std::wstring path =  L"./scenes/scene_00.xml";
     //std::wstring path =  L"./scenes/scene_01.xml";
 
-    std::vector<xml_component> components;
-    std::wstring result = read_xml(components, path);
+    xml_document doc;
+    std::wstring result = read_xml(doc, path);
     if (result != L"")
         return result;
-    return pprint_components(components);
+    return pprint_components(doc.components);
 }
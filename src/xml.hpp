@@ -1,35 +1,133 @@
-
 #ifndef XML_HPP
 #define XML_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// Read-only view of a whole file, memory mapped so loading a scene costs
+// address space rather than heap.
+struct mapped_file
+{
+    mapped_file() = default;
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    ~mapped_file();
+
+    std::wstring open(const std::wstring& path); // Empty string on success
+    std::string_view bytes() const { return std::string_view(data, size); }
+
+private:
+    const char *data = nullptr;
+    std::size_t size = 0;
+#ifdef _WIN32
+    void *file = nullptr, *mapping = nullptr;
+#endif
+};
+
+// Keys and tag names interned to small integers at parse time, so the scene
+// compiler can switch on them instead of comparing strings. The ones it knows
+// about have fixed ids; anything else a scene uses is numbered from
+// XML_ATOM_COUNT up, in order of first appearance.
+enum xml_atom : int
+{
+    XML_ATOM_NONE = -1,
+    XML_ATOM_TAG = 0,
+    XML_ATOM_NAME,
+    XML_ATOM_TYPE,
+    XML_ATOM_OBJECT,
+    XML_ATOM_MATERIAL,
+    XML_ATOM_LIGHT,
+    XML_ATOM_CAMERA,
+    XML_ATOM_FOV,
+    XML_ATOM_WIDTH,
+    XML_ATOM_HEIGHT,
+    XML_ATOM_SPECULAR,
+    XML_ATOM_ROTATION,
+    XML_ATOM_SCALE,
+    XML_ATOM_TRANSLATE,
+    XML_ATOM_POSITION,
+    XML_ATOM_TARGET,
+    XML_ATOM_UP,
+    XML_ATOM_DIFFUSE,
+    XML_ATOM_GLOSSINESS,
+    XML_ATOM_INTENSITY,
+    XML_ATOM_DIRECTION,
+    XML_ATOM_VALUE,
+    XML_ATOM_ANGLE,
+    XML_ATOM_X,
+    XML_ATOM_Y,
+    XML_ATOM_Z,
+    XML_ATOM_R,
+    XML_ATOM_G,
+    XML_ATOM_B,
+    XML_ATOM_COUNT
+};
+
+// Spelling of a fixed atom, empty for the rest
+std::string_view xml_atom_name(xml_atom atom);
+
+// Open addressed string -> atom map. Names are views, so they must outlive the
+// table (the mapped file, or literals for the fixed atoms).
+struct xml_atom_table
+{
+    xml_atom_table();
+
+    xml_atom intern(std::string_view s);
+    xml_atom find(std::string_view s) const; // XML_ATOM_NONE if never interned
+    std::string_view name(xml_atom atom) const { return names[atom]; }
+    int size() const { return static_cast<int>(names.size()); }
+
+private:
+    std::vector<std::string_view> names;
+    std::vector<std::uint32_t> hashes; // Per atom
+    std::vector<int> slots;            // Power of two, -1 is empty
+
+    void grow();
+};
+
+// key and value are UTF-8 spans into the xml_document they came from (the
+// mapped file, or strings the document owns), so a component is the same 48
+// bytes however long its text is. Decode with wkey()/wvalue() when a wide
+// string is really needed. key_atom is key interned; tag_atom is the tag name
+// (value) for "tag" components and XML_ATOM_NONE for everything else.
 struct xml_component
 {
     int id, parent_id;
-    std::wstring key, value;
-
-    xml_component() : id(-1), parent_id(-1), key(L""), value(L"") {}
-    xml_component(int i, int p, const std::wstring& k, const std::wstring& v) :
-        id(i), parent_id(p), key(k), value(v) {}
-    xml_component(const xml_component& c) :
-        id(c.id), parent_id(c.parent_id), key(c.key), value(c.value) {}
-    xml_component& operator=(const xml_component& c)
-    {
-        if (this != &c)
-        {
-            id = c.id;
-            parent_id = c.parent_id;
-            key = c.key;
-            value = c.value;
-        }
-        return *this;
-    }
+    xml_atom key_atom, tag_atom;
+    std::string_view key, value;
+
+    xml_component() : id(-1), parent_id(-1), key_atom(XML_ATOM_NONE), tag_atom(XML_ATOM_NONE) {}
+    xml_component(int i, int p, xml_atom ka, xml_atom ta, std::string_view k, std::string_view v) :
+        id(i), parent_id(p), key_atom(ka), tag_atom(ta), key(k), value(v) {}
+
+    std::wstring wkey() const;
+    std::wstring wvalue() const;
 };
 
+// A parsed scene file. Components point into it, so it stays put (no copies
+// or moves) for as long as they are in use.
+struct xml_document
+{
+    mapped_file file;
+    std::string path; // UTF-8, the value of the root's "name" component
+    xml_atom_table atoms;
+    std::vector<xml_component> components;
+
+    xml_document() = default;
+    xml_document(const xml_document&) = delete;
+    xml_document& operator=(const xml_document&) = delete;
+};
+
+// UTF-8 to wchar_t (UTF-16 with surrogates on Windows, UTF-32 elsewhere).
+// Malformed bytes come out as U+FFFD.
+std::wstring utf8_to_wide(std::string_view s);
+std::string wide_to_utf8(const std::wstring& s);
+
 std::wstring pprint_components(const std::vector<xml_component>& components);
-std::wstring read_xml(std::vector<xml_component>& components, const std::wstring& path);
+std::wstring read_xml(xml_document& doc, const std::wstring& path);
 std::wstring xml_test();
 
 #endif // XML_HPP
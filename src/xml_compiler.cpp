@@ -66,9 +66,37 @@ void radix_sort(int *map, int map_len)
     delete[] tmp;
 }
 
-bool xml_kv_cmp(const xml_component& comp, const std::wstring &key, const std::wstring &val)
+// Tags that become float1s and float3s, and keys that become strings.
+// NOTE: specular and rotation are in both to encode float4s
+bool is_float1_tag(xml_atom tag)
 {
-    return comp.key == key && comp.value == val;
+    switch(tag)
+    {
+        case XML_ATOM_FOV: case XML_ATOM_WIDTH: case XML_ATOM_HEIGHT:
+        case XML_ATOM_SPECULAR: case XML_ATOM_ROTATION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_float3_tag(xml_atom tag)
+{
+    switch(tag)
+    {
+        case XML_ATOM_SCALE: case XML_ATOM_TRANSLATE: case XML_ATOM_POSITION: case XML_ATOM_TARGET: case XML_ATOM_UP:
+        case XML_ATOM_DIFFUSE: case XML_ATOM_GLOSSINESS:
+        case XML_ATOM_INTENSITY: case XML_ATOM_DIRECTION:
+        case XML_ATOM_SPECULAR: case XML_ATOM_ROTATION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_string_key(xml_atom key)
+{
+    return key == XML_ATOM_TYPE || key == XML_ATOM_NAME || key == XML_ATOM_MATERIAL;
 }
 
 int find_xml_entity_parent(
@@ -95,25 +123,6 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         if (comp.parent_id != -1)
             xml_leaves[comp.parent_id]++;
 
-    const std::vector<std::wstring> float1_keys = {
-        //L"scale", L"fov", L"width", L"height"
-        L"fov", L"width", L"height",
-        
-        // NOTE: THE FOLLOWING ARE IN BOTH TO ENCODE FLOAT4S
-        L"specular", L"rotation",
-    };
-    const std::vector<std::wstring> float3_keys = {
-        L"scale", L"translate", L"position", L"target", L"up",
-        L"diffuse", L"glossiness", //L"specular",
-        L"intensity", L"direction",
-
-        // NOTE: THE FOLLOWING ARE IN BOTH TO ENCODE FLOAT4S
-        L"specular", L"rotation",
-    };
-    const std::vector<std::wstring> string_keys = {
-        L"type", L"name", L"material",
-    };
-
     // Gather renderable instance counts
     //for (const xml_component& comp : components)
     for(int n=0; n<components.size(); n++)
@@ -123,29 +132,25 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         // Objects
         //if(0 < comp.parent_id){
         //    const xml_component prnt = components[comp.parent_id];
-        //    if(xml_kv_cmp(comp, L"type", L"object") && xml_kv_cmp(prnt, L"tag", L"object"))
+        //    if(xml_kv_cmp(comp, "type", "object") && xml_kv_cmp(prnt, "tag", "object"))
         //        Renderables.objects.len++;
         //}
-        if(xml_kv_cmp(comp, L"tag", L"object"))
-            Renderables.objects.len++;
-        if(xml_kv_cmp(comp, L"tag", L"material"))
-            Renderables.materials.len++;
-        if(xml_kv_cmp(comp, L"tag", L"light"))
-            Renderables.lights.len++;
-
-        if(xml_kv_cmp(comp, L"tag", L"camera"))
-            Renderables.cameras.len++;
+        switch(comp.tag_atom)
+        {
+            case XML_ATOM_OBJECT:   Renderables.objects.len++;   break;
+            case XML_ATOM_MATERIAL: Renderables.materials.len++; break;
+            case XML_ATOM_LIGHT:    Renderables.lights.len++;    break;
+            case XML_ATOM_CAMERA:   Renderables.cameras.len++;   break;
+            default: break;
+        }
         
         // Components
-        for(const std::wstring& key : float1_keys)
-            if(xml_kv_cmp(comp, L"tag", key))
-                Renderables.float1s.len++;
-        for(const std::wstring& key : float3_keys)
-            if(xml_kv_cmp(comp, L"tag", key))
-                Renderables.float3s.len++;
-        for(const std::wstring& key : string_keys) // Note: this should grab type from object. This is intentional!
-            if(comp.key == key) // Values are irrelevant?
-                Renderables.strings.len++;
+        if(is_float1_tag(comp.tag_atom))
+            Renderables.float1s.len++;
+        if(is_float3_tag(comp.tag_atom))
+            Renderables.float3s.len++;
+        if(is_string_key(comp.key_atom)) // Note: this should grab type from object. This is intentional! Values are irrelevant?
+            Renderables.strings.len++;
     }
 
     Renderables.entities.len = Renderables.objects.len + Renderables.materials.len
@@ -187,8 +192,8 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         if(comp.parent_id == -1) continue;
 
         const xml_component& prnt = components[comp.parent_id];
-        //if (xml_kv_cmp(comp, L"type", L"object") && xml_kv_cmp(prnt, L"tag", L"object"))
-        if(xml_kv_cmp(comp, L"tag", L"object"))
+        //if (xml_kv_cmp(comp, "type", "object") && xml_kv_cmp(prnt, "tag", "object"))
+        if(comp.tag_atom == XML_ATOM_OBJECT)
         {
             Renderables.objects.map[objects_visited] = n;//prnt.id; // Dont use n for this one
             Renderables.objects[objects_visited].entity = entities_visited;
@@ -199,7 +204,7 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
             continue;
         }
 
-        if(xml_kv_cmp(comp, L"tag", L"material"))
+        if(comp.tag_atom == XML_ATOM_MATERIAL)
         {
             Renderables.materials.map[materials_visited] = n;
             Renderables.materials[materials_visited].entity = entities_visited;
@@ -210,7 +215,7 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
             continue;
         }
 
-        if(xml_kv_cmp(comp, L"tag", L"light"))
+        if(comp.tag_atom == XML_ATOM_LIGHT)
         {
             Renderables.lights.map[lights_visited] = n;
             Renderables.lights[lights_visited].entity = entities_visited;
@@ -221,7 +226,7 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
             continue;
         }
 
-        if(xml_kv_cmp(comp, L"tag", L"camera"))
+        if(comp.tag_atom == XML_ATOM_CAMERA)
         {
             Renderables.cameras.map[cameras_visited] = n;
             Renderables.cameras[cameras_visited].entity = entities_visited;
@@ -244,42 +249,30 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
     {
         const xml_component& comp = components[n];
 
-        for(const std::wstring& key : float1_keys)
+        if(is_float1_tag(comp.tag_atom))
         {
-            if(xml_kv_cmp(comp, L"tag", key))
-            {
-                Renderables.float1s.map[float1s_visited] = n;
-                Renderables.float1s[float1s_visited].key = key;
-                Renderables.float1s[float1s_visited].entity = 
-                    find_xml_entity_parent(components, Renderables.entities, n);
-                float1s_visited++;
-                break;
-            }
+            Renderables.float1s.map[float1s_visited] = n;
+            Renderables.float1s[float1s_visited].key = comp.tag_atom;
+            Renderables.float1s[float1s_visited].entity = 
+                find_xml_entity_parent(components, Renderables.entities, n);
+            float1s_visited++;
         }
-        for(const std::wstring& key : float3_keys)
+        if(is_float3_tag(comp.tag_atom))
         {
-            if(xml_kv_cmp(comp, L"tag", key))
-            {
-                Renderables.float3s.map[float3s_visited] = n;
-                Renderables.float3s[float3s_visited].key = key;
-                Renderables.float3s[float3s_visited].entity = 
-                    find_xml_entity_parent(components, Renderables.entities, n);
-                float3s_visited++;
-                break;
-            }
+            Renderables.float3s.map[float3s_visited] = n;
+            Renderables.float3s[float3s_visited].key = comp.tag_atom;
+            Renderables.float3s[float3s_visited].entity = 
+                find_xml_entity_parent(components, Renderables.entities, n);
+            float3s_visited++;
         }
-        for(const std::wstring& key : string_keys)
+        if(is_string_key(comp.key_atom))
         {
-            if(comp.key == key)
-            {
-                Renderables.strings.map[strings_visited] = n;
-                Renderables.strings[strings_visited].key = key;
-                Renderables.strings[strings_visited].value = comp.value; // I might as well do this here
-                Renderables.strings[strings_visited].entity = 
-                    find_xml_entity_parent(components, Renderables.entities, n);
-                strings_visited++;
-                break;
-            }
+            Renderables.strings.map[strings_visited] = n;
+            Renderables.strings[strings_visited].key = comp.key_atom;
+            Renderables.strings[strings_visited].value = comp.wvalue(); // I might as well do this here
+            Renderables.strings[strings_visited].entity = 
+                find_xml_entity_parent(components, Renderables.entities, n);
+            strings_visited++;
         }
     }
 
@@ -304,12 +297,12 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         {
             xml_ir_float1 &f1 = Renderables.float1s[eid];
             float val = decode<float>(comp.value);
-            if(f1.key != L"specular" && f1.key != L"rotation")
+            if(f1.key != XML_ATOM_SPECULAR && f1.key != XML_ATOM_ROTATION)
             {
                 Renderables.float1s[eid].x = val;
                 continue;
             }
-            else if(comp.key == L"value" || comp.key == L"angle")
+            else if(comp.key_atom == XML_ATOM_VALUE || comp.key_atom == XML_ATOM_ANGLE)
             {
                 Renderables.float1s[eid].x = val;
                 continue;
@@ -325,15 +318,19 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
             xml_ir_float3 &f3 = Renderables.float3s[eid];
             float val = decode<float>(comp.value);
             // Determine the float3 slot via a common mapping
-            if(comp.key == L"x" || comp.key == L"r") {f3.x = val; continue;}
-            if(comp.key == L"y" || comp.key == L"g") {f3.y = val; continue;}
-            if(comp.key == L"z" || comp.key == L"b") {f3.z = val; continue;}
+            switch(comp.key_atom)
+            {
+                case XML_ATOM_X: case XML_ATOM_R: f3.x = val; continue;
+                case XML_ATOM_Y: case XML_ATOM_G: f3.y = val; continue;
+                case XML_ATOM_Z: case XML_ATOM_B: f3.z = val; continue;
+                default: break;
+            }
 
             // Oddball mapping: scale. Scale can be a float1, but we'll encode it as
             // a float3, as it can *sometimes* have 3 children. When its a float3, its
             // handled by the code above. But, if its a float1, it needs to fill all
             // three slots. This should only fire if any of the previous ones fail.
-            if(f3.key == L"scale" || f3.key == L"glossiness" || f3.key == L"intensity")
+            if(f3.key == XML_ATOM_SCALE || f3.key == XML_ATOM_GLOSSINESS || f3.key == XML_ATOM_INTENSITY)
             {
                 f3.x = val;
                 f3.y = val;
@@ -369,19 +366,19 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         int ent_type = Renderables.entities[s.entity];
         if(ent_type == ENT_Object)
         {
-            if(s.key == L"name") Renderables.objects[s.entity].name = s.value;
-            if(s.key == L"type") Renderables.objects[s.entity].type = s.value;
-            if(s.key == L"material") Renderables.objects[s.entity].mat = s.value;
+            if(s.key == XML_ATOM_NAME) Renderables.objects[s.entity].name = s.value;
+            if(s.key == XML_ATOM_TYPE) Renderables.objects[s.entity].type = s.value;
+            if(s.key == XML_ATOM_MATERIAL) Renderables.objects[s.entity].mat = s.value;
         }
         if(ent_type == ENT_Material)
         {
-            if(s.key == L"name") Renderables.materials[s.entity].name = s.value;
-            if(s.key == L"type") Renderables.materials[s.entity].type = s.value;
+            if(s.key == XML_ATOM_NAME) Renderables.materials[s.entity].name = s.value;
+            if(s.key == XML_ATOM_TYPE) Renderables.materials[s.entity].type = s.value;
         }
         if(ent_type == ENT_Light)
         {
-            if(s.key == L"name") Renderables.lights[s.entity].name = s.value;
-            if(s.key == L"type") Renderables.lights[s.entity].type = s.value;
+            if(s.key == XML_ATOM_NAME) Renderables.lights[s.entity].name = s.value;
+            if(s.key == XML_ATOM_TYPE) Renderables.lights[s.entity].type = s.value;
         }
         if(ent_type == ENT_Camera)
             ; // Camera has no name
@@ -394,18 +391,18 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         int ent_type = Renderables.entities[s.entity];
         if(ent_type == ENT_Object)
         {
-            //if(s.key == L"scale") Renderables.objects[s.entity].radius = s.x;
-            if(s.key == L"rotation") Renderables.objects[s.entity].rotation[3] = s.x * (3.141592653589793f/180.0f); // Easiest spot to do the conversion I suppose
+            //if(s.key == XML_ATOM_SCALE) Renderables.objects[s.entity].radius = s.x;
+            if(s.key == XML_ATOM_ROTATION) Renderables.objects[s.entity].rotation[3] = s.x * (3.141592653589793f/180.0f); // Easiest spot to do the conversion I suppose
         }
         if(ent_type == ENT_Camera)
         {
-            if(s.key == L"fov") Renderables.cameras[s.entity].fov_deg = s.x;
-            if(s.key == L"width") Renderables.cameras[s.entity].w = s.x;
-            if(s.key == L"height") Renderables.cameras[s.entity].h = s.x;
+            if(s.key == XML_ATOM_FOV) Renderables.cameras[s.entity].fov_deg = s.x;
+            if(s.key == XML_ATOM_WIDTH) Renderables.cameras[s.entity].w = s.x;
+            if(s.key == XML_ATOM_HEIGHT) Renderables.cameras[s.entity].h = s.x;
         }
         if(ent_type == ENT_Material)
         {
-            if(s.key == L"specular") Renderables.materials[s.entity].glossiness_value = s.x;
+            if(s.key == XML_ATOM_SPECULAR) Renderables.materials[s.entity].glossiness_value = s.x;
         }
     }
 
@@ -416,19 +413,19 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         int ent_type = Renderables.entities[s.entity];
         if(ent_type == ENT_Object)
         {
-            if(s.key == L"translate")
+            if(s.key == XML_ATOM_TRANSLATE)
             {
                 Renderables.objects[s.entity].pos[0] = s.x;
                 Renderables.objects[s.entity].pos[1] = s.y;
                 Renderables.objects[s.entity].pos[2] = s.z;
             }
-            if(s.key == L"scale")
+            if(s.key == XML_ATOM_SCALE)
             {
                 Renderables.objects[s.entity].scale[0] = s.x;
                 Renderables.objects[s.entity].scale[1] = s.y;
                 Renderables.objects[s.entity].scale[2] = s.z;
             }
-            if(s.key == L"rotation")
+            if(s.key == XML_ATOM_ROTATION)
             {
                 Renderables.objects[s.entity].rotation[0] = s.x;
                 Renderables.objects[s.entity].rotation[1] = s.y;
@@ -437,19 +434,19 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         }
         if(ent_type == ENT_Material)
         {
-            if(s.key == L"diffuse")
+            if(s.key == XML_ATOM_DIFFUSE)
             {
                 Renderables.materials[s.entity].albedo[0] = s.x;
                 Renderables.materials[s.entity].albedo[1] = s.y;
                 Renderables.materials[s.entity].albedo[2] = s.z;
             }
-            if(s.key == L"specular")
+            if(s.key == XML_ATOM_SPECULAR)
             {
                 Renderables.materials[s.entity].spec_color[0] = s.x;
                 Renderables.materials[s.entity].spec_color[1] = s.y;
                 Renderables.materials[s.entity].spec_color[2] = s.z;
             }
-            if(s.key == L"glossiness")
+            if(s.key == XML_ATOM_GLOSSINESS)
             {
                 Renderables.materials[s.entity].glossiness[0] = s.x;
                 Renderables.materials[s.entity].glossiness[1] = s.y;
@@ -458,19 +455,19 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         }
         if(ent_type == ENT_Light)
         {
-            if(s.key == L"intensity")
+            if(s.key == XML_ATOM_INTENSITY)
             {
                 Renderables.lights[s.entity].intensity[0] = s.x;
                 Renderables.lights[s.entity].intensity[1] = s.y;
                 Renderables.lights[s.entity].intensity[2] = s.z;
             }
-            if(s.key == L"direction")
+            if(s.key == XML_ATOM_DIRECTION)
             {
                 Renderables.lights[s.entity].direction[0] = s.x;
                 Renderables.lights[s.entity].direction[1] = s.y;
                 Renderables.lights[s.entity].direction[2] = s.z;
             }
-            if(s.key == L"position")
+            if(s.key == XML_ATOM_POSITION)
             {
                 Renderables.lights[s.entity].position[0] = s.x;
                 Renderables.lights[s.entity].position[1] = s.y;
@@ -479,19 +476,19 @@ void init_renderables(renderables &Renderables, const std::vector<xml_component>
         }
         if(ent_type == ENT_Camera)
         {
-            if(s.key == L"position")
+            if(s.key == XML_ATOM_POSITION)
             {
                 Renderables.cameras[s.entity].pos[0] = s.x;
                 Renderables.cameras[s.entity].pos[1] = s.y;
                 Renderables.cameras[s.entity].pos[2] = s.z;
             } 
-            if(s.key == L"target")
+            if(s.key == XML_ATOM_TARGET)
             {
                 Renderables.cameras[s.entity].target[0] = s.x;
                 Renderables.cameras[s.entity].target[1] = s.y;
                 Renderables.cameras[s.entity].target[2] = s.z;
             }
-            if(s.key == L"up")
+            if(s.key == XML_ATOM_UP)
             {
                 Renderables.cameras[s.entity].up[0] = s.x;
                 Renderables.cameras[s.entity].up[1] = s.y;
@@ -620,7 +617,7 @@ inline void print_xml_ir_float1(const xml_ir_float1& v, int idx)
     std::wcout
         << L"  [" << idx << L"]"
         << L" entity=" << v.entity
-        << L" key=\"" << v.key << L"\""
+        << L" key=\"" << utf8_to_wide(xml_atom_name(v.key)) << L"\""
         << L" x=" << v.x
         << L"\n";
 }
@@ -630,7 +627,7 @@ inline void print_xml_ir_float3(const xml_ir_float3& v, int idx)
     std::wcout
         << L"  [" << idx << L"]"
         << L" entity=" << v.entity
-        << L" key=\"" << v.key << L"\""
+        << L" key=\"" << utf8_to_wide(xml_atom_name(v.key)) << L"\""
         << L" x=(" << v.x << L"," << v.y << L"," << v.z << L")"
         << L"\n";
 }
@@ -640,7 +637,7 @@ inline void print_xml_ir_string(const xml_ir_string& v, int idx)
     std::wcout
         << L"  [" << idx << L"]"
         << L" entity=" << v.entity
-        << L" key=\"" << v.key << L"\""
+        << L" key=\"" << utf8_to_wide(xml_atom_name(v.key)) << L"\""
         << L" value=\"" << v.value << L"\""
         << L"\n";
 }
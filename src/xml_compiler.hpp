@@ -13,6 +13,7 @@
 #endif
 
 #include <string>
+#include <cstring>
 #include <charconv>
 #include <stdexcept>
 #include <algorithm>
@@ -167,14 +168,14 @@ struct camera
 struct xml_ir_float1
 {
     int entity;
-    std::wstring key;
+    xml_atom key;
     float x;
 };
 
 struct xml_ir_float3
 {
     int entity;
-    std::wstring key;
+    xml_atom key;
     float x;
     float y;
     float z;
@@ -183,7 +184,7 @@ struct xml_ir_float3
 struct xml_ir_string
 {
     int entity;
-    std::wstring key;
+    xml_atom key;
     std::wstring value;
 };
 
@@ -238,6 +239,26 @@ inline std::string narrow_ascii(const std::wstring& wstr)
     return str;
 }
 
+template<typename T>
+T decode(std::string_view value, bool &success)
+{
+    T out;
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+    success = (ec == std::errc() && ptr == value.data() + value.size());
+    return out;
+}
+
+template<typename T>
+T decode(std::string_view value)
+{
+    T out;
+    bool success;
+    out = decode<T>(value, success);
+    if (!success)
+        throw std::runtime_error("Failed to decode value: " + std::string(value));
+    return out;
+}
+
 template<typename T>
 T decode(const std::wstring& value, bool &success)
 {